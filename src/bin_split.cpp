@@ -0,0 +1,278 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <signal.h>
+
+#include <atomic>
+#include <bin_split.hpp>
+#include <bit>
+#include <cmath>
+#include <debug.hpp>
+#include <format>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <ui.hpp>
+#include <worker_pool.hpp>
+
+namespace smrty
+{
+
+namespace
+{
+
+// show progress for computations of at least this many digits
+constexpr int progress_digits = 100000;
+
+std::atomic<bool> canceled{false};
+// set while any cancel_scope routes Ctrl-C to canceled
+std::atomic<bool> armed{false};
+
+// the live scopes and the handler they replaced; the first scope in
+// installs the handler and the last one out puts the old one back
+std::mutex scope_lock{};
+size_t scopes = 0;
+struct sigaction saved_action{};
+
+// progress lines from different threads must not interleave
+std::mutex progress_lock{};
+
+extern "C" void on_interrupt(int)
+{
+    canceled = true;
+}
+
+// route Ctrl-C to the cancel flag while a long computation runs; a
+// Ctrl-C cancels every computation that is running at the time
+class cancel_scope
+{
+  public:
+    cancel_scope()
+    {
+        std::lock_guard<std::mutex> guard(scope_lock);
+        if (scopes++ == 0)
+        {
+            canceled = false;
+            struct sigaction sa{};
+            sa.sa_handler = on_interrupt;
+            sigemptyset(&sa.sa_mask);
+            sigaction(SIGINT, &sa, &saved_action);
+            armed = true;
+        }
+    }
+    ~cancel_scope()
+    {
+        std::lock_guard<std::mutex> guard(scope_lock);
+        if (--scopes == 0)
+        {
+            sigaction(SIGINT, &saved_action, nullptr);
+            armed = false;
+            canceled = false;
+        }
+    }
+    cancel_scope(const cancel_scope&) = delete;
+    cancel_scope& operator=(const cancel_scope&) = delete;
+};
+
+// only a Ctrl-C during an active scope cancels, so an earlier interrupt
+// cannot leak into later, unscoped computations
+bool interrupted()
+{
+    return armed && canceled;
+}
+
+// P(a,b), Q(a,b) and T(a,b) for the terms a <= k < b of a series whose
+// terms have the ratio p(k)/q(k); the partial sum is T/Q
+struct pqt
+{
+    mpz p;
+    mpz q;
+    mpz t;
+};
+
+// the values for a single term k
+using leaf_fn = std::function<pqt(unsigned long k)>;
+
+pqt merge(pqt&& l, pqt&& r)
+{
+    pqt m{};
+    m.t = l.t * r.q + l.p * r.t;
+    m.p = l.p * r.p;
+    m.q = l.q * r.q;
+    return m;
+}
+
+pqt split(const leaf_fn& leaf, unsigned long a, unsigned long b)
+{
+    if (interrupted())
+    {
+        throw std::runtime_error("Canceled");
+    }
+    if (b - a == 1)
+    {
+        return leaf(a);
+    }
+    unsigned long m = (a + b) / 2;
+    return merge(split(leaf, a, m), split(leaf, m, b));
+}
+
+// sum the first terms of the series to get T/Q
+pqt sum_series(const char* name, const leaf_fn& leaf, unsigned long terms,
+               int digits)
+{
+    std::optional<cancel_scope> cancel{};
+    bool show = digits >= progress_digits;
+    if (show)
+    {
+        cancel.emplace();
+    }
+    auto& pool = worker_pool::get();
+    // about four pieces per thread keeps every thread busy to the end
+    size_t pieces = std::min<size_t>(terms, pool.concurrency() * 4);
+    // each piece is one step and so is each level of merges
+    size_t steps = pieces + std::bit_width(pieces - 1);
+    std::atomic<size_t> done{0};
+    size_t shown = 0;
+    auto progress = [&]() {
+        size_t d = ++done;
+        if (show)
+        {
+            // only write when the percentage has moved on
+            std::lock_guard<std::mutex> guard(progress_lock);
+            size_t percent = d * 100 / steps;
+            if (percent > shown)
+            {
+                shown = percent;
+                ui::get()->err(std::format("\r{}: {}% (Ctrl-C to cancel)",
+                                           name, percent));
+            }
+        }
+    };
+
+    std::vector<pqt> parts(pieces);
+    pool.parallel_for(pieces, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            unsigned long a = terms * i / pieces;
+            unsigned long b = terms * (i + 1) / pieces;
+            parts[i] = split(leaf, a, b);
+            progress();
+        }
+    });
+    // merge neighbors level by level, like the splitting would have
+    for (size_t step = 1; step < pieces; step *= 2)
+    {
+        size_t pairs = (pieces + 2 * step - 1) / (2 * step);
+        pool.parallel_for(pairs, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++)
+            {
+                if (interrupted())
+                {
+                    throw std::runtime_error("Canceled");
+                }
+                size_t i = 2 * step * k;
+                if (i + step < pieces)
+                {
+                    parts[i] = merge(std::move(parts[i]),
+                                     std::move(parts[i + step]));
+                }
+            }
+        });
+        progress();
+    }
+    if (show)
+    {
+        std::lock_guard<std::mutex> guard(progress_lock);
+        ui::get()->err("\r\033[K");
+    }
+    lg::debug("{}: summed {} terms in {} pieces\n", name, terms, pieces);
+    return std::move(parts[0]);
+}
+
+unsigned long terms_for(int digits, double digits_per_term)
+{
+    // a few guard digits absorb the rounding of the final division
+    return static_cast<unsigned long>(std::ceil((digits + 10) /
+                                                digits_per_term)) +
+           2;
+}
+
+} // namespace
+
+mpf bin_split_pi(int digits)
+{
+    // 1/pi = 12 * sum((-1)^k * (6k)! * (13591409 + 545140134k) /
+    //                 ((3k)! * k!^3 * 640320^(3k + 3/2)))
+    static const mpz c3_24{mpz{640320} * mpz{640320} * mpz{640320} / 24};
+    auto leaf = [](unsigned long k) -> pqt {
+        mpz a = mpz{13591409} + mpz{545140134} * mpz{k};
+        if (k == 0)
+        {
+            return {mpz{1}, mpz{1}, a};
+        }
+        mpz p = -(mpz{6 * k - 5} * mpz{2 * k - 1} * mpz{6 * k - 1});
+        mpz q = mpz{k} * mpz{k} * mpz{k} * c3_24;
+        mpz t = p * a;
+        return {std::move(p), std::move(q), std::move(t)};
+    };
+    pqt s = sum_series("pi", leaf, terms_for(digits, 14.18), digits);
+    return mpf{426880} * sqrt_fn(mpf{10005}) * mpf{s.q} / mpf{s.t};
+}
+
+mpf bin_split_e(int digits)
+{
+    // e = sum(1/k!); the ratio of term k to term k-1 is 1/k
+    auto leaf = [](unsigned long k) -> pqt {
+        mpz q{k == 0 ? 1 : k};
+        return {mpz{1}, std::move(q), mpz{1}};
+    };
+    // the number of terms n for which n! > 10^digits
+    unsigned long n = 1;
+    for (double log_fact = 0; log_fact < digits + 10; n++)
+    {
+        log_fact += std::log10(static_cast<double>(n));
+    }
+    pqt s = sum_series("e", leaf, n + 1, digits);
+    return mpf{s.t} / mpf{s.q};
+}
+
+mpf bin_split_ln2(int digits)
+{
+    // the ratio of term k to term k-1 is -k / (8k + 4)
+    auto leaf = [](unsigned long k) -> pqt {
+        if (k == 0)
+        {
+            return {mpz{1}, mpz{1}, mpz{1}};
+        }
+        mpz p = -mpz{k};
+        mpz t = p;
+        return {std::move(p), mpz{8 * k + 4}, std::move(t)};
+    };
+    pqt s = sum_series("ln2", leaf, terms_for(digits, std::log10(8.0)),
+                       digits);
+    return mpf{3} * mpf{s.t} / (mpf{4} * mpf{s.q});
+}
+
+mpf bin_split_sqrt2(int digits)
+{
+    // sqrt(1 + x) = sum(binomial(1/2, k) * x^k) with x = 1/49; the ratio of
+    // term k to term k-1 is (3 - 2k) / 98k
+    auto leaf = [](unsigned long k) -> pqt {
+        if (k == 0)
+        {
+            return {mpz{1}, mpz{1}, mpz{1}};
+        }
+        mpz p = mpz{3} - mpz{2 * k};
+        mpz t = p;
+        return {std::move(p), mpz{98 * k}, std::move(t)};
+    };
+    pqt s = sum_series("sqrt2", leaf, terms_for(digits, std::log10(49.0)),
+                       digits);
+    return mpf{7} * mpf{s.t} / (mpf{5} * mpf{s.q});
+}
+
+} // namespace smrty
@@ -0,0 +1,28 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+#pragma once
+
+#include <numeric.hpp>
+
+namespace smrty
+{
+
+/*
+ * Constants from hypergeometric series summed by binary splitting. The
+ * series is cut into pieces that are split on the worker pool and then
+ * merged pairwise, also in parallel, so all the exact integer work is
+ * done before a single division at the end. Each returns the constant to
+ * the given number of decimal digits (at the current precision).
+ *
+ * Large computations report their progress on stderr and can be canceled
+ * with Ctrl-C, which throws std::runtime_error.
+ */
+mpf bin_split_pi(int digits);    // Chudnovsky
+mpf bin_split_e(int digits);     // sum(1/k!)
+mpf bin_split_ln2(int digits);   // 3/4 * sum((-1)^k * k!^2 / (2^k * (2k+1)!))
+mpf bin_split_sqrt2(int digits); // 7/5 * sqrt(1 + 1/49) as a binomial series
+
+} // namespace smrty
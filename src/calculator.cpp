@@ -75,6 +75,20 @@ void Calculator::save_state(const std::filesystem::path& filename)
         for (auto it = stack.rbegin(); it != stack.rend(); it++)
         {
             const auto& entry = *it;
+            if (entry.pending())
+            {
+                // background work gets a chance to finish; failures are
+                // not saved
+                try
+                {
+                    entry.value();
+                }
+                catch (const std::exception& e)
+                {
+                    lg::error("Not saving stack entry: {}\n", e.what());
+                    continue;
+                }
+            }
             // each entry has a separate precision, base, unit, signed, and bits
             // manually enter those here to ensure proper reproduction of values
 
@@ -186,10 +200,22 @@ Calculator::Calculator()
     setup_catalog();
 }
 
+Calculator::Calculator(const Calculator& parent, const no_touchy&) :
+    config(parent.config), flags(parent.flags),
+    variables(parent.variables), worker(true)
+{
+    config.interactive = false;
+}
+
 Calculator::~Calculator()
 {
 }
 
+std::unique_ptr<Calculator> Calculator::fork() const
+{
+    return std::make_unique<Calculator>(*this, no_touchy{});
+}
+
 std::string binary_to_hex(std::string_view v)
 {
     std::string out;
@@ -629,7 +655,10 @@ bool Calculator::base(unsigned int b)
         case 10:
         case 16:
             config.base = b;
-            parser::set_current_base(b);
+            if (!worker)
+            {
+                parser::set_current_base(b);
+            }
             return true;
     }
     return false;
@@ -653,7 +682,14 @@ bool Calculator::precision(unsigned int p)
 {
     p = std::min(p, max_precision);
     config.precision = p;
-    set_default_precision(p);
+    if (worker)
+    {
+        set_thread_precision(p);
+    }
+    else
+    {
+        set_default_precision(p);
+    }
     return false;
 }
 
@@ -666,6 +702,22 @@ bool Calculator::tz_mode()
 std::string Calculator::format_stack_entry(const stack_entry& e,
                                            size_t first_col)
 {
+    // never wait on background work just to draw the stack
+    if (e.pending())
+    {
+        if (!e.ready())
+        {
+            return std::format("<pending: {}>", e.description());
+        }
+        try
+        {
+            e.value();
+        }
+        catch (const std::exception& err)
+        {
+            return std::format("<error: {}>", err.what());
+        }
+    }
     auto& v = e.value();
     auto& u = e.unit();
     if (auto q = std::get_if<mpq>(&v); q)
@@ -780,10 +832,11 @@ void Calculator::show_stack()
                         base = "hex";
                         break;
                 }
-                auto debug_prefix =
-                    std::format("{}{},p:{},{},{} | ", it->is_signed ? 's' : 'u',
-                                it->fixed_bits, it->precision, base,
-                                numeric_types[it->value().index()]);
+                auto debug_prefix = std::format(
+                    "{}{},p:{},{},{} | ", it->is_signed ? 's' : 'u',
+                    it->fixed_bits, it->precision, base,
+                    it->ready() ? numeric_types[it->value().index()]
+                                : "pending");
                 ui->out(debug_prefix);
                 first_col += debug_prefix.size();
             }
@@ -74,6 +74,7 @@ class Calculator
     Calculator(const no_touchy&) : Calculator()
     {
     }
+    Calculator(const Calculator& parent, const no_touchy&);
     ~Calculator();
     void save_state(const std::filesystem::path& filename);
     // to require access via get(); no copies
@@ -83,6 +84,10 @@ class Calculator
     Calculator& operator=(Calculator&&) = delete;
     static Calculator& get()
     {
+        if (_context)
+        {
+            return *_context;
+        }
         static std::unique_ptr<Calculator> _this{};
         if (!_this)
         {
@@ -90,6 +95,35 @@ class Calculator
         }
         return *_this;
     }
+
+    // A worker calculator starts with a copy of the settings, flags and
+    // variables of its parent and an empty stack. It is meant to run
+    // programs on a worker thread; it has no input and may not change
+    // the function library.
+    std::unique_ptr<Calculator> fork() const;
+    bool is_worker() const
+    {
+        return worker;
+    }
+    // while in scope, Calculator::get() on this thread returns ctx
+    class scoped_context
+    {
+      public:
+        explicit scoped_context(Calculator& ctx) : prev(_context)
+        {
+            _context = &ctx;
+        }
+        ~scoped_context()
+        {
+            _context = prev;
+        }
+        scoped_context(const scoped_context&) = delete;
+        scoped_context& operator=(const scoped_context&) = delete;
+
+      protected:
+        Calculator* prev;
+    };
+
     bool run(std::string_view);
     bool run_help(std::string_view fn = {});
     void stop()
@@ -135,6 +169,9 @@ class Calculator
     void show_stack();
 
     bool _running = true;
+    bool worker = false;
+
+    static inline thread_local Calculator* _context = nullptr;
 
     std::shared_ptr<Input> input;
 };
@@ -31,7 +31,7 @@ struct _e : public CalcFunction
 
     virtual bool op(Calculator& calc) const final
     {
-        stack_entry e(boost::math::constants::e<mpf>(), calc.config.base,
+        stack_entry e(get_constant(math_constant::e), calc.config.base,
                       calc.config.fixed_bits, calc.config.precision,
                       calc.config.is_signed, calc.flags);
         calc.stack.push_front(std::move(e));
@@ -73,7 +73,7 @@ struct _pi : public CalcFunction
 
     virtual bool op(Calculator& calc) const final
     {
-        stack_entry pi(boost::math::constants::pi<mpf>(), calc.config.base,
+        stack_entry pi(get_constant(math_constant::pi), calc.config.base,
                        calc.config.fixed_bits, calc.config.precision,
                        calc.config.is_signed, calc.flags);
         calc.stack.push_front(std::move(pi));
@@ -14,12 +14,13 @@ namespace smrty
 {
 
 if_elif_statement::if_elif_statement() :
-    branches(), current_branch(branches.begin())
+    branches(), current_branch(branches.begin()), state(phase::start)
 {
 }
 
 if_elif_statement::if_elif_statement(const if_elif_statement& o) :
-    branches(o.branches), current_branch(branches.begin())
+    branches(o.branches), current_branch(branches.begin()),
+    state(phase::start)
 {
 }
 
@@ -27,6 +28,11 @@ if_elif_statement::~if_elif_statement()
 {
 }
 
+statement::ptr if_elif_statement::clone() const
+{
+    return std::make_shared<if_elif_statement>(*this);
+}
+
 void if_elif_statement::set_cond(const std::vector<simple_instruction>& s)
 {
     branches.emplace_back(std::make_tuple(true, simple_program{s}, program{}));
@@ -45,106 +51,84 @@ void if_elif_statement::set_else(const std::vector<instruction>& s)
     current_branch = branches.begin();
 }
 
-const simple_instruction&
-    if_elif_statement::branch_next_item(execution_flags& flags)
+void if_elif_statement::reset()
 {
-    auto& [test_phase, condition, body] = *current_branch;
-    /*
-    if (lg::debug_level == lg::level::debug)
-    {
-        // are we on the first branch
-        if (condition.next == condition.body.begin())
-        {
-            if (current_branch == branches.begin())
-            {
-                if (condition.next == condition.body.begin())
-                {
-                    lg::debug("Starting [IF] condition execution\n");
-                }
-            }
-            else if (condition.size() != 0)
-            {
-                lg::debug("Starting [ELIF] condition execution\n");
-            }
-            else
-            {
-                lg::debug("Starting [ELSE] body execution\n");
-            }
-        }
-    }
-    */
-    if (condition.body.size() && test_phase)
-    {
-        lg::debug("Executing next item in condition\n");
-        if (const auto& itm = condition.next_item(flags); !is_noop(itm))
-        {
-            return itm;
-        }
-        lg::debug("End of condition; flags: z({}) c({}) o({}) s({})\n",
-                  flags.zero, flags.carry, flags.overflow, flags.sign);
-        // drop the item used for test
-        auto& calc = Calculator::get();
-        if (calc.stack.size())
-        {
-            calc.stack.pop_front();
-        }
-        if (flags.zero)
-        {
-            return noop;
-        }
-        test_phase = false;
-    }
-    if (auto& itm = body.next_item(flags); !is_noop(itm))
-    {
-        return itm;
-    }
-    test_phase = true;
-    return noop;
+    current_branch = branches.begin();
+    state = phase::start;
 }
 
-const simple_instruction& if_elif_statement::next_item(execution_flags& flags)
+statement::step_result if_elif_statement::step(execution_flags& flags)
 {
     while (current_branch != branches.end())
     {
-        bool continue_next = std::get<bool>(*current_branch);
-        if (const auto& itm = branch_next_item(flags); !is_noop(itm))
+        auto& [unused, condition, body] = *current_branch;
+        switch (state)
         {
-            return itm;
-        }
-        // the condition was true and we are finished
-        // executing the body. Reset conditional.
-        if (!continue_next)
-        {
-            current_branch = branches.begin();
-            return noop;
+            case phase::start:
+                if (condition.body.size())
+                {
+                    lg::debug("Executing condition\n");
+                    state = phase::test;
+                    return {nullptr, &condition};
+                }
+                // else has no condition
+                state = phase::body;
+                return {nullptr, &body};
+            case phase::test:
+            {
+                lg::debug(
+                    "End of condition; flags: z({}) c({}) o({}) s({})\n",
+                    flags.zero, flags.carry, flags.overflow, flags.sign);
+                // drop the item used for test
+                auto& calc = Calculator::get();
+                if (calc.stack.size())
+                {
+                    calc.stack.pop_front();
+                }
+                if (flags.zero)
+                {
+                    current_branch++;
+                    state = phase::start;
+                    continue;
+                }
+                state = phase::body;
+                return {nullptr, &body};
+            }
+            case phase::body:
+                // the branch that was taken is finished
+                current_branch = branches.end();
+                break;
         }
-        current_branch++;
     }
-    current_branch = branches.begin();
-    return noop;
+    return {};
 }
 
 // user provides while loop conditional
-while_statement::while_statement() : cond(), body(), in_cond(true)
+while_statement::while_statement() : cond(), body(), state(phase::cond)
 {
 }
 
 while_statement::while_statement(const while_statement& o) :
-    cond(o.cond), body(o.body), in_cond(true)
+    cond(o.cond), body(o.body), state(phase::cond)
 {
 }
 while_statement& while_statement::operator=(const while_statement& o)
 {
     cond = o.cond;
     body = o.body;
-    in_cond = true;
+    state = phase::cond;
     return *this;
 }
 
+statement::ptr while_statement::clone() const
+{
+    return std::make_shared<while_statement>(*this);
+}
+
 void while_statement::set_cond(const std::vector<simple_instruction>& s)
 {
     cond = simple_program{s};
-    in_cond = true;
+    state = phase::cond;
 }
 
 void while_statement::set_body(const std::vector<instruction>& s)
@@ -152,17 +136,22 @@ void while_statement::set_body(const std::vector<instruction>& s)
     body = program{s};
 }
 
-const simple_instruction& while_statement::next_item(execution_flags& flags)
+void while_statement::reset()
+{
+    state = phase::cond;
+}
+
+statement::step_result while_statement::step(execution_flags& flags)
 {
-    do
+    switch (state)
     {
-        if (in_cond)
+        case phase::cond:
+        case phase::body:
+            // evaluate the condition first and after each pass of the body
+            state = phase::test;
+            return {nullptr, &cond};
+        case phase::test:
         {
-            // keep processing setup instructions until last instruction
-            if (auto& itm = cond.next_item(flags); !is_noop(itm))
-            {
-                return itm;
-            }
             // pop the final item that we just measured
             auto& calc = Calculator::get();
             if (calc.stack.size())
@@ -171,45 +160,33 @@ const simple_instruction& while_statement::next_item(execution_flags& flags)
             }
             if (flags.zero)
             {
-                break;
+                state = phase::finished;
+                return {};
             }
-            in_cond = false;
+            state = phase::body;
+            return {nullptr, &body};
         }
+        case phase::finished:
+            break;
+    }
+    return {};
+}
 
-        // loop body
-        if (auto& itm = body.next_item(flags); !is_noop(itm))
-        {
-            // check for break/continue
-            if (auto i = std::get_if<keyword>(&itm); i)
-            {
-                if (i->word == "break")
-                {
-                    body.quit();
-                    break;
-                }
-                if (i->word == "continue")
-                {
-                    body.quit();
-                    in_cond = true;
-                    continue;
-                }
-            }
-            return itm;
-        }
-        in_cond = true;
-    } while (1);
-    return noop;
+bool while_statement::loop_control(const keyword& k)
+{
+    state = (k.word == "break") ? phase::finished : phase::cond;
+    return true;
 }
 
 // generate loop conditional based on var name and list of items to iterate
 for_statement::for_statement() :
-    setup(), body(), var_name(), values(), val_iter(), in_setup(true)
+    setup(), body(), var_name(), values(), val_iter(), state(phase::setup)
 {
 }
 
 for_statement::for_statement(const for_statement& o) :
     setup(o.setup), body(o.body), var_name(o.var_name), values(), val_iter(),
-    in_setup(true)
+    state(phase::setup)
 {
 }
 
@@ -220,10 +197,15 @@ for_statement& for_statement::operator=(const for_statement& o)
     var_name = o.var_name;
     values = o.values;
     val_iter = values.begin();
-    in_setup = true;
+    state = phase::setup;
     return *this;
 }
 
+statement::ptr for_statement::clone() const
+{
+    return std::make_shared<for_statement>(*this);
+}
+
 void for_statement::set_var(const symbolic& name)
 {
     var_name = std::get<std::string>((*name).left);
@@ -232,7 +214,7 @@ void for_statement::set_var(const symbolic& name)
 void for_statement::set_setup(const std::vector<simple_instruction>& s)
 {
     setup = simple_program{s};
-    in_setup = true;
+    state = phase::setup;
 }
 
 void for_statement::set_body(const std::vector<instruction>& s)
@@ -240,79 +222,71 @@ void for_statement::set_body(const std::vector<instruction>& s)
     body = program{s};
 }
 
-const simple_instruction& for_statement::next_item(execution_flags& flags)
+void for_statement::reset()
 {
-    auto& calc = Calculator::get();
-    if (in_setup)
-    {
-        lg::debug("setup: {}; next: {}\n", setup, *(setup.next));
-        // keep processing setup instructions until last instruction
-        // test stack item to ensure it is a list
-        if (auto& itm = setup.next_item(flags); !is_noop(itm))
-        {
-            return itm;
-        }
-        if (calc.stack.size() < 1)
-        {
-            throw std::invalid_argument(
-                "FOR loop setup resulted in an empty stack");
-        }
-        auto& e = calc.stack.front();
-        auto& v = e.value();
-        auto l = std::get_if<list>(&v);
-        if (!l)
-        {
-            throw std::invalid_argument(
-                "FOR loop setup did not evaluate to a list");
-        }
-        values = *l;
-        val_iter = values.begin();
-        calc.stack.pop_front();
-        if (val_iter == values.end())
-        {
-            // end of loop
-            return noop;
-        }
-        lg::debug("values is {}; next {} is {}\n", values, var_name, *val_iter);
-        calc.set_var(var_name, variant_cast(*val_iter));
-        in_setup = false;
-    }
+    state = phase::setup;
+}
 
-    auto for_loop_advance = [&calc, this]() {
-        val_iter++;
-        if (val_iter == values.end())
-        {
-            // end of loop
-            in_setup = true;
-            return false;
-        }
-        calc.set_var(var_name, variant_cast(*val_iter));
-        return true;
-    };
-    do
+statement::step_result for_statement::step(execution_flags&)
+{
+    auto& calc = Calculator::get();
+    switch (state)
     {
-        // loop body
-        if (auto& itm = body.next_item(flags); !is_noop(itm))
+        case phase::setup:
+            // run the user-provided setup to create the list
+            state = phase::start;
+            return {nullptr, &setup};
+        case phase::start:
         {
-            // check for break/continue
-            if (auto i = std::get_if<keyword>(&itm); i)
+            if (calc.stack.size() < 1)
             {
-                if (i->word == "break")
-                {
-                    body.quit();
-                    break;
-                }
-                if (i->word == "continue")
-                {
-                    body.quit();
-                    in_setup = true;
-                    continue;
-                }
+                throw std::invalid_argument(
+                    "FOR loop setup resulted in an empty stack");
+            }
+            auto& e = calc.stack.front();
+            auto& v = e.value();
+            auto l = std::get_if<list>(&v);
+            if (!l)
+            {
+                throw std::invalid_argument(
+                    "FOR loop setup did not evaluate to a list");
+            }
+            values = *l;
+            val_iter = values.begin();
+            calc.stack.pop_front();
+            if (val_iter == values.end())
+            {
+                // end of loop
+                state = phase::finished;
+                return {};
             }
-            return itm;
+            lg::debug("values is {}; next {} is {}\n", values, var_name,
+                      *val_iter);
+            calc.set_var(var_name, variant_cast(*val_iter));
+            state = phase::body;
+            return {nullptr, &body};
         }
-    } while (for_loop_advance());
-    return noop;
+        case phase::body:
+            // the body finished a pass; advance to the next value
+            val_iter++;
+            if (val_iter == values.end())
+            {
+                state = phase::finished;
+                return {};
+            }
+            calc.set_var(var_name, variant_cast(*val_iter));
+            return {nullptr, &body};
+        case phase::finished:
+            break;
+    }
+    return {};
+}
+
+bool for_statement::loop_control(const keyword& k)
+{
+    // continue leaves the state at body, which advances on the next step
+    state = (k.word == "break") ? phase::finished : phase::body;
+    return true;
 }
 
 } // namespace smrty
@@ -27,8 +27,9 @@ struct if_elif_statement : public statement
     void set_body(const std::vector<instruction>&);
     void set_else(const std::vector<instruction>&);
 
-    const simple_instruction& branch_next_item(execution_flags&);
-    virtual const simple_instruction& next_item(execution_flags&) final;
+    virtual void reset() final;
+    virtual step_result step(execution_flags&) final;
+    virtual statement::ptr clone() const final;
 
     // possible parser helpers
     // if_elif_statement(condition)
@@ -38,6 +39,14 @@ struct if_elif_statement : public statement
     using condition = std::tuple<bool, simple_program, program>;
     std::vector<condition> branches;
     std::vector<condition>::iterator current_branch;
+
+    enum class phase
+    {
+        start,
+        test,
+        body,
+    };
+    phase state;
 };
 
 struct while_statement : public statement
@@ -49,11 +58,22 @@ struct while_statement : public statement
     void set_cond(const std::vector<simple_instruction>&);
     void set_body(const std::vector<instruction>&);
 
-    virtual const simple_instruction& next_item(execution_flags&);
+    virtual void reset();
+    virtual step_result step(execution_flags&);
+    virtual bool loop_control(const keyword&);
+    virtual statement::ptr clone() const;
 
     simple_program cond;
     program body;
-    bool in_cond;
+
+    enum class phase
+    {
+        cond,
+        test,
+        body,
+        finished,
+    };
+    phase state;
 };
 
 struct for_statement : public statement
@@ -66,7 +86,10 @@ struct for_statement : public statement
     void set_setup(const std::vector<simple_instruction>&);
     void set_body(const std::vector<instruction>&);
 
-    virtual const simple_instruction& next_item(execution_flags&);
+    virtual void reset();
+    virtual step_result step(execution_flags&);
+    virtual bool loop_control(const keyword&);
+    virtual statement::ptr clone() const;
 
     // setup is user-provided mechanism for creating the list of items
     simple_program setup;
@@ -74,7 +97,15 @@ struct for_statement : public statement
     std::string var_name;
     list values;
     list::iterator val_iter;
-    bool in_setup;
+
+    enum class phase
+    {
+        setup,
+        start,
+        body,
+        finished,
+    };
+    phase state;
 };
 
 } // namespace smrty
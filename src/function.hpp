@@ -5,6 +5,7 @@ SPDX-License-Identifier: BSD-3-Clause
 */
 
 #pragma once
+#include <array>
 #include <boost/multiprecision/number.hpp>
 #include <calculator.hpp>
 #include <cmath>
@@ -15,6 +16,7 @@ SPDX-License-Identifier: BSD-3-Clause
 #include <functional>
 #include <map>
 #include <numeric.hpp>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <type_helpers.hpp>
@@ -57,21 +59,132 @@ struct conversion<std::tuple<Ti...>, std::tuple<To...>>
     }
 };
 
-template <typename Fn>
-bool one_arg_op(Calculator& calc, const Fn& fn)
+/*
+ * stack_args takes the top N entries off of the stack for an operation.
+ * The arity is checked before the stack is touched and the entries are
+ * moved off rather than copied. args[0] is the deepest argument (x) and
+ * args[N - 1] is the top of the stack. If the operation throws before it
+ * calls push() or commit(), the entries are put back as they were.
+ */
+template <size_t N>
+class stack_args
+{
+  public:
+    explicit stack_args(Calculator& calc) : calc(calc)
+    {
+        if (calc.stack.size() < N)
+        {
+            throw insufficient_args();
+        }
+        for (size_t i = N; i > 0; i--)
+        {
+            entries[i - 1] = std::move(calc.stack.front());
+            calc.stack.pop_front();
+        }
+    }
+    ~stack_args()
+    {
+        if (committed)
+        {
+            return;
+        }
+        for (size_t i = 0; i < N; i++)
+        {
+            if (taken[i])
+            {
+                entries[i].value(std::move(*taken[i]));
+            }
+            calc.stack.push_front(std::move(entries[i]));
+        }
+    }
+    stack_args(const stack_args&) = delete;
+    stack_args& operator=(const stack_args&) = delete;
+
+    stack_entry& operator[](size_t i)
+    {
+        return entries[i];
+    }
+    // hand the value of argument i to the operation, which may reuse it
+    numeric& take(size_t i)
+    {
+        if (!taken[i])
+        {
+            taken[i] = entries[i].take_value();
+        }
+        return *taken[i];
+    }
+    // results are as precise as the least precise argument
+    int precision() const
+    {
+        int p = entries[0].precision;
+        for (size_t i = 1; i < N; i++)
+        {
+            p = std::min(p, entries[i].precision);
+        }
+        return p;
+    }
+    void commit()
+    {
+        committed = true;
+    }
+    // push the result of the operation; the arguments are consumed
+    void push(numeric&& v, const units::unit& u)
+    {
+        calc.stack.emplace_front(std::move(v), u, calc.config.base,
+                                 calc.config.fixed_bits, precision(),
+                                 calc.config.is_signed, calc.flags);
+        committed = true;
+    }
+
+  protected:
+    Calculator& calc;
+    std::array<stack_entry, N> entries;
+    std::array<std::optional<numeric>, N> taken;
+    bool committed = false;
+};
+
+/*
+ * copy v into the limited variant out; if v holds one of Ti, it is
+ * converted to the matching To on the way (without an intermediate copy)
+ */
+template <typename... Ti, typename... To, typename Out>
+bool convert_arg(const numeric& v, Out& out, ITypes<Ti...>, OTypes<To...>)
 {
-    if (calc.stack.size() < 1)
+    static_assert(sizeof...(Ti) == sizeof...(To));
+    int state = 0; // 0: not converted, 1: converted, -1: failed
+    auto try_one = [&v, &out, &state]<typename I, typename O>() {
+        auto p = std::get_if<I>(&v);
+        if (state != 0 || !p)
+        {
+            return;
+        }
+        if constexpr (variant_has_member<O, Out>::value)
+        {
+            out = coerce_variant<O>(*p);
+            state = 1;
+        }
+        else
+        {
+            state = -1;
+        }
+    };
+    (try_one.template operator()<Ti, To>(), ...);
+    if (state != 0)
     {
-        throw std::invalid_argument("Requires 1 argument");
+        return state > 0;
     }
-    stack_entry& a = calc.stack.front();
+    return reduce(v, out)();
+}
+
+template <typename Fn>
+bool one_arg_op(Calculator& calc, const Fn& fn)
+{
+    stack_args<1> args(calc);
+    stack_entry& a = args[0];
 
     auto [cv, nu] = std::visit(
-        [&fn, ua{a.unit()}](const auto& a) { return fn(a, ua); }, a.value());
-    calc.stack.pop_front();
-    calc.stack.emplace_front(std::move(cv), nu, calc.config.base,
-                             calc.config.fixed_bits, a.precision,
-                             calc.config.is_signed, calc.flags);
+        [&fn, &ua = a.unit()](auto& a) { return fn(a, ua); }, args.take(0));
+    args.push(std::move(cv), nu);
     return true;
 }
 
@@ -90,27 +203,19 @@ struct one_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
     template <typename Fn>
     static bool op(Calculator& calc, const Fn& fn)
     {
-        if (calc.stack.size() < 1)
-        {
-            throw std::invalid_argument("Requires 1 argument");
-        }
-        stack_entry& a = calc.stack.front();
-        numeric ca = a.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(ca);
+        stack_args<1> args(calc);
+        stack_entry& a = args[0];
         std::variant<Ltypes...> lca;
-        if (!reduce(ca, lca)())
+        if (!convert_arg(a.value(), lca, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}))
         {
             throw std::runtime_error(
                 "Argument failed to reduce after conversion");
         }
 
         auto [cv, nu] = std::visit(
-            [&fn, ua{a.unit()}](const auto& a) { return fn(a, ua); }, lca);
-        calc.stack.pop_front();
-
-        calc.stack.emplace_front(std::move(cv), nu, calc.config.base,
-                                 calc.config.fixed_bits, a.precision,
-                                 calc.config.is_signed, calc.flags);
+            [&fn, &ua = a.unit()](auto& a) { return fn(a, ua); }, lca);
+        args.push(std::move(cv), nu);
         return true;
     }
 };
@@ -118,11 +223,8 @@ struct one_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
 template <typename... AllowedTypes, typename Fn>
 bool one_arg_limited_op(Calculator& calc, const Fn& fn)
 {
-    if (calc.stack.size() < 1)
-    {
-        throw std::invalid_argument("Requires 1 argument");
-    }
-    stack_entry& a = calc.stack.front();
+    stack_args<1> args(calc);
+    stack_entry& a = args[0];
     std::variant<AllowedTypes...> la;
     if (!variant_holds_type<AllowedTypes...>(a.value()))
     {
@@ -133,24 +235,17 @@ bool one_arg_limited_op(Calculator& calc, const Fn& fn)
         throw std::runtime_error("Argument failed to reduce after conversion");
     }
 
-    auto [cv, nu] = std::visit(
-        [&fn, ua{a.unit()}](const auto& a) { return fn(a, ua); }, la);
-
-    calc.stack.pop_front();
-    calc.stack.emplace_front(std::move(cv), nu, calc.config.base,
-                             calc.config.fixed_bits, a.precision,
-                             calc.config.is_signed, calc.flags);
+    auto [cv, nu] =
+        std::visit([&fn, &ua = a.unit()](auto& a) { return fn(a, ua); }, la);
+    args.push(std::move(cv), nu);
     return true;
 }
 
 template <typename... AllowedTypes, typename Fn>
 bool one_arg_limited_multi_return_op(Calculator& calc, const Fn& fn)
 {
-    if (calc.stack.size() < 1)
-    {
-        throw std::invalid_argument("Requires 1 argument");
-    }
-    stack_entry& a = calc.stack.front();
+    stack_args<1> args(calc);
+    stack_entry& a = args[0];
     std::variant<AllowedTypes...> la;
     if (!variant_holds_type<AllowedTypes...>(a.value()))
     {
@@ -162,13 +257,14 @@ bool one_arg_limited_multi_return_op(Calculator& calc, const Fn& fn)
     }
 
     std::vector<std::tuple<numeric, units::unit>> values = std::visit(
-        [&fn, ua{a.unit()}](const auto& a) { return fn(a, ua); }, la);
+        [&fn, &ua = a.unit()](auto& a) { return fn(a, ua); }, la);
 
-    calc.stack.pop_front();
+    int precision = args.precision();
+    args.commit();
     for (auto& [cv, nu] : values)
     {
         calc.stack.emplace_front(std::move(cv), nu, calc.config.base,
-                                 calc.config.fixed_bits, a.precision,
+                                 calc.config.fixed_bits, precision,
                                  calc.config.is_signed, calc.flags);
     }
     return true;
@@ -177,12 +273,9 @@ bool one_arg_limited_multi_return_op(Calculator& calc, const Fn& fn)
 template <typename Fn>
 bool two_arg_op(Calculator& calc, const Fn& fn)
 {
-    if (calc.stack.size() < 2)
-    {
-        throw std::invalid_argument("Requires 2 arguments");
-    }
-    stack_entry& a = calc.stack[1];
-    stack_entry& b = calc.stack[0];
+    stack_args<2> args(calc);
+    stack_entry& a = args[0];
+    stack_entry& b = args[1];
 
     if (a.unit().compat(b.unit()))
     {
@@ -190,29 +283,20 @@ bool two_arg_op(Calculator& calc, const Fn& fn)
         b.value(units::convert(b.value(), b.unit(), a.unit()), calc.flags);
     }
     auto [cv, nu] = std::visit(
-        [&fn, ua{a.unit()}, ub{b.unit()}](const auto& a, const auto& b) {
+        [&fn, &ua = a.unit(), &ub = b.unit()](auto& a, auto& b) {
             return fn(a, b, ua, ub);
         },
-        a.value(), b.value());
-
-    calc.stack.pop_front();
-    calc.stack.pop_front();
-
-    calc.stack.emplace_front(
-        std::move(cv), nu, calc.config.base, calc.config.fixed_bits,
-        std::min(a.precision, b.precision), calc.config.is_signed, calc.flags);
+        args.take(0), args.take(1));
+    args.push(std::move(cv), nu);
     return true;
 }
 
 template <typename Fn>
 bool two_arg_uconv_op(Calculator& calc, const Fn& fn)
 {
-    if (calc.stack.size() < 2)
-    {
-        throw std::invalid_argument("Requires 2 arguments");
-    }
-    stack_entry& a = calc.stack[1];
-    stack_entry& b = calc.stack[0];
+    stack_args<2> args(calc);
+    stack_entry& a = args[0];
+    stack_entry& b = args[1];
 
     if (a.unit() != b.unit())
     {
@@ -234,17 +318,11 @@ bool two_arg_uconv_op(Calculator& calc, const Fn& fn)
     }
 
     auto [cv, nu] = std::visit(
-        [&fn, ua{a.unit()}, ub{b.unit()}](const auto& a, const auto& b) {
+        [&fn, &ua = a.unit(), &ub = b.unit()](auto& a, auto& b) {
             return fn(a, b, ua, ub);
         },
-        a.value(), b.value());
-
-    calc.stack.pop_front();
-    calc.stack.pop_front();
-
-    calc.stack.emplace_front(
-        std::move(cv), nu, calc.config.base, calc.config.fixed_bits,
-        std::min(a.precision, b.precision), calc.config.is_signed, calc.flags);
+        args.take(0), args.take(1));
+    args.push(std::move(cv), nu);
     return true;
 }
 
@@ -264,12 +342,9 @@ struct two_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
     template <typename Fn>
     static bool op(Calculator& calc, const Fn& fn)
     {
-        if (calc.stack.size() < 2)
-        {
-            throw std::invalid_argument("Requires 2 arguments");
-        }
-        stack_entry& a = calc.stack[1];
-        stack_entry& b = calc.stack[0];
+        stack_args<2> args(calc);
+        stack_entry& a = args[0];
+        stack_entry& b = args[1];
 
         lg::debug("a: ({} (type {}))\n", a.value(), DEBUG_TYPE(a.value()));
         lg::debug("b: ({} (type {}))\n", b.value(), DEBUG_TYPE(b.value()));
@@ -280,13 +355,12 @@ struct two_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
         }
         lg::debug("a: ({} (type {}))\n", a.value(), DEBUG_TYPE(a.value()));
         lg::debug("b: ({} (type {}))\n", b.value(), DEBUG_TYPE(b.value()));
-        numeric ca = a.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(ca);
-        numeric cb = b.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(cb);
         std::variant<Ltypes...> lca;
         std::variant<Ltypes...> lcb;
-        if (!reduce(ca, lca)() || !reduce(cb, lcb)())
+        if (!convert_arg(a.value(), lca, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}) ||
+            !convert_arg(b.value(), lcb, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}))
         {
             throw std::runtime_error(
                 "Argument(s) failed to reduce after conversion");
@@ -294,20 +368,13 @@ struct two_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
         lg::debug("a: ({} (type {}))\n", lca, DEBUG_TYPE(lca));
         lg::debug("b: ({} (type {}))\n", lcb, DEBUG_TYPE(lcb));
         auto [cv, nu] = std::visit(
-            [&fn, ua{a.unit()}, ub{b.unit()}](const auto& a, const auto& b) {
+            [&fn, &ua = a.unit(), &ub = b.unit()](auto& a, auto& b) {
                 lg::debug("a: ({} (type {}))\n", a, DEBUG_TYPE(a));
                 lg::debug("b: ({} (type {}))\n", b, DEBUG_TYPE(b));
                 return fn(a, b, ua, ub);
             },
             lca, lcb);
-
-        calc.stack.pop_front();
-        calc.stack.pop_front();
-
-        calc.stack.emplace_front(std::move(cv), nu, calc.config.base,
-                                 calc.config.fixed_bits,
-                                 std::min(a.precision, b.precision),
-                                 calc.config.is_signed, calc.flags);
+        args.push(std::move(cv), nu);
         return true;
     }
 };
@@ -315,13 +382,9 @@ struct two_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
 template <typename... AllowedTypes, typename Fn>
 bool two_arg_limited_op(Calculator& calc, const Fn& fn)
 {
-    if (calc.stack.size() < 2)
-    {
-        throw std::invalid_argument("Requires 2 arguments");
-    }
-
-    stack_entry& a = calc.stack[1];
-    stack_entry& b = calc.stack[0];
+    stack_args<2> args(calc);
+    stack_entry& a = args[0];
+    stack_entry& b = args[1];
 
     if (!variant_holds_type<AllowedTypes...>(a.value()) ||
         !variant_holds_type<AllowedTypes...>(b.value()))
@@ -342,16 +405,11 @@ bool two_arg_limited_op(Calculator& calc, const Fn& fn)
         b.value(units::convert(b.value(), b.unit(), a.unit()), calc.flags);
     }
     auto [cv, nu] = std::visit(
-        [&fn, ua{a.unit()}, ub{b.unit()}](const auto& a, const auto& b) {
+        [&fn, &ua = a.unit(), &ub = b.unit()](auto& a, auto& b) {
             return fn(a, b, ua, ub);
         },
         la, lb);
-    calc.stack.pop_front();
-    calc.stack.pop_front();
-
-    calc.stack.emplace_front(
-        std::move(cv), nu, calc.config.base, calc.config.fixed_bits,
-        std::min(a.precision, b.precision), calc.config.is_signed, calc.flags);
+    args.push(std::move(cv), nu);
     return true;
 }
 
@@ -359,14 +417,10 @@ template <typename... AllowedTypes, typename Fn>
 bool three_arg_limited_op(Calculator& calc, const Fn& fn,
                           const std::tuple<AllowedTypes...>& /*allowed types*/)
 {
-    if (calc.stack.size() < 3)
-    {
-        throw std::invalid_argument("Requires 3 arguments");
-    }
-
-    stack_entry& a = calc.stack[2];
-    stack_entry& b = calc.stack[1];
-    stack_entry& c = calc.stack[0];
+    stack_args<3> args(calc);
+    stack_entry& a = args[0];
+    stack_entry& b = args[1];
+    stack_entry& c = args[2];
 
     if (a.unit().compat(b.unit()))
     {
@@ -394,20 +448,13 @@ bool three_arg_limited_op(Calculator& calc, const Fn& fn,
             "Argument(s) failed to reduce after conversion");
     }
 
-    auto [cv, nu] =
-        std::visit([&fn, ua{a.unit()}, ub{b.unit()}, uc{c.unit()}](
-                       const auto& a, const auto& b,
-                       const auto& c) { return fn(a, b, c, ua, ub, uc); },
-                   la, lb, lc);
-
-    calc.stack.pop_front();
-    calc.stack.pop_front();
-    calc.stack.pop_front();
-
-    calc.stack.emplace_front(std::move(cv), nu, calc.config.base,
-                             calc.config.fixed_bits,
-                             std::min({a.precision, b.precision, c.precision}),
-                             calc.config.is_signed, calc.flags);
+    auto [cv, nu] = std::visit(
+        [&fn, &ua = a.unit(), &ub = b.unit(),
+         &uc = c.unit()](auto& a, auto& b, auto& c) {
+            return fn(a, b, c, ua, ub, uc);
+        },
+        la, lb, lc);
+    args.push(std::move(cv), nu);
     return true;
 }
 
@@ -426,13 +473,10 @@ struct three_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
     template <typename Fn>
     static bool op(Calculator& calc, const Fn& fn)
     {
-        if (calc.stack.size() < 3)
-        {
-            throw std::invalid_argument("Requires 3 arguments");
-        }
-        stack_entry& a = calc.stack[2];
-        stack_entry& b = calc.stack[1];
-        stack_entry& c = calc.stack[0];
+        stack_args<3> args(calc);
+        stack_entry& a = args[0];
+        stack_entry& b = args[1];
+        stack_entry& c = args[2];
 
         if ((a.unit() != units::unit()) || (b.unit() != units::unit()) ||
             (c.unit() != units::unit()))
@@ -440,32 +484,23 @@ struct three_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
             throw units_prohibited();
         }
 
-        numeric ca = a.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(ca);
-        numeric cb = b.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(cb);
-        numeric cc = c.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(cc);
         std::variant<Ltypes...> lca;
         std::variant<Ltypes...> lcb;
         std::variant<Ltypes...> lcc;
-        if (!reduce(ca, lca)() || !reduce(cb, lcb)() || !reduce(cc, lcc)())
+        if (!convert_arg(a.value(), lca, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}) ||
+            !convert_arg(b.value(), lcb, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}) ||
+            !convert_arg(c.value(), lcc, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}))
         {
             throw std::runtime_error(
                 "Argument(s) failed to reduce after conversion");
         }
-        auto cv = std::visit([&fn](const auto& a, const auto& b,
-                                   const auto& c) { return fn(a, b, c); },
+        auto cv = std::visit([&fn](auto& a, auto& b,
+                                   auto& c) { return fn(a, b, c); },
                              lca, lcb, lcc);
-
-        calc.stack.pop_front();
-        calc.stack.pop_front();
-        calc.stack.pop_front();
-
-        calc.stack.emplace_front(std::move(cv), units::unit(), calc.config.base,
-                                 calc.config.fixed_bits,
-                                 std::min(a.precision, b.precision),
-                                 calc.config.is_signed, calc.flags);
+        args.push(std::move(cv), units::unit());
         return true;
     }
 };
@@ -485,14 +520,11 @@ struct four_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
     template <typename Fn>
     static bool op(Calculator& calc, const Fn& fn)
     {
-        if (calc.stack.size() < 4)
-        {
-            throw std::invalid_argument("Requires 4 arguments");
-        }
-        stack_entry& a = calc.stack[3];
-        stack_entry& b = calc.stack[2];
-        stack_entry& c = calc.stack[1];
-        stack_entry& d = calc.stack[0];
+        stack_args<4> args(calc);
+        stack_entry& a = args[0];
+        stack_entry& b = args[1];
+        stack_entry& c = args[2];
+        stack_entry& d = args[3];
 
         if ((a.unit() != units::unit()) || (b.unit() != units::unit()) ||
             (c.unit() != units::unit()) || (d.unit() != units::unit()))
@@ -500,43 +532,44 @@ struct four_arg_conv<ITypes<Itypes...>, OTypes<Otypes...>, LTypes<Ltypes...>>
             throw units_prohibited();
         }
 
-        numeric ca = a.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(ca);
-        numeric cb = b.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(cb);
-        numeric cc = c.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(cc);
-        numeric cd = d.value();
-        conversion<std::tuple<Itypes...>, std::tuple<Otypes...>>::op(cd);
         std::variant<Ltypes...> lca;
         std::variant<Ltypes...> lcb;
         std::variant<Ltypes...> lcc;
         std::variant<Ltypes...> lcd;
-        if (!reduce(ca, lca)() || !reduce(cb, lcb)() || !reduce(cc, lcc)() ||
-            !reduce(cd, lcd)())
+        if (!convert_arg(a.value(), lca, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}) ||
+            !convert_arg(b.value(), lcb, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}) ||
+            !convert_arg(c.value(), lcc, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}) ||
+            !convert_arg(d.value(), lcd, ITypes<Itypes...>{},
+                         OTypes<Otypes...>{}))
         {
             throw std::runtime_error(
                 "Argument(s) failed to reduce after conversion");
         }
-        auto cv = std::visit([&fn](const auto& a, const auto& b, const auto& c,
-                                   const auto& d) { return fn(a, b, c, d); },
+        auto cv = std::visit([&fn](auto& a, auto& b, auto& c,
+                                   auto& d) { return fn(a, b, c, d); },
                              lca, lcb, lcc, lcd);
-
-        calc.stack.pop_front();
-        calc.stack.pop_front();
-        calc.stack.pop_front();
-        calc.stack.pop_front();
-
-        calc.stack.emplace_front(std::move(cv), units::unit(), calc.config.base,
-                                 calc.config.fixed_bits,
-                                 std::min(a.precision, b.precision),
-                                 calc.config.is_signed, calc.flags);
+        args.push(std::move(cv), units::unit());
         return true;
     }
 };
 
-static const mpf one_eighty_f{180.0l};
-static const mpf two_hundred_f{200.0l};
+// fn(a), or the hardware floating point version of it for real arguments
+// when that is good enough for the current precision
+template <typename Fn>
+auto hw_float_op(hw_fn f, const auto& a, const Fn& fn)
+{
+    if constexpr (same_type_v<decltype(a), mpf>)
+    {
+        if (auto r = hw_float_eval(f, a); r)
+        {
+            return std::move(*r);
+        }
+    }
+    return fn(a);
+}
 
 template <typename Fn>
 std::tuple<numeric, units::unit> scaled_trig_op(Calculator& calc, auto a,
@@ -550,11 +583,11 @@ std::tuple<numeric, units::unit> scaled_trig_op(Calculator& calc, auto a,
     {
         if (calc.config.angle_mode == Calculator::e_angle_mode::degrees)
         {
-            a *= boost::math::constants::pi<mpf>() / one_eighty_f;
+            a *= get_constant(math_constant::rad_per_deg);
         }
         else if (calc.config.angle_mode == Calculator::e_angle_mode::gradians)
         {
-            a *= boost::math::constants::pi<mpf>() / two_hundred_f;
+            a *= get_constant(math_constant::rad_per_grad);
         }
         return {fn(a), units::unit()};
     }
@@ -573,11 +606,11 @@ std::tuple<numeric, units::unit> scaled_trig_op_inv(Calculator& calc,
     {
         if (calc.config.angle_mode == Calculator::e_angle_mode::degrees)
         {
-            b *= one_eighty_f / boost::math::constants::pi<mpf>();
+            b *= get_constant(math_constant::deg_per_rad);
         }
         else if (calc.config.angle_mode == Calculator::e_angle_mode::gradians)
         {
-            b *= two_hundred_f / boost::math::constants::pi<mpf>();
+            b *= get_constant(math_constant::grad_per_rad);
         }
         return {b, units::unit()};
     }
@@ -591,11 +624,11 @@ std::tuple<numeric, units::unit>
     auto c = fn(a, b);
     if (calc.config.angle_mode == Calculator::e_angle_mode::degrees)
     {
-        c *= one_eighty_f / boost::math::constants::pi<mpf>();
+        c *= get_constant(math_constant::deg_per_rad);
     }
     else if (calc.config.angle_mode == Calculator::e_angle_mode::gradians)
     {
-        c *= two_hundred_f / boost::math::constants::pi<mpf>();
+        c *= get_constant(math_constant::grad_per_rad);
     }
     return {c, units::unit()};
 }
@@ -3,9 +3,12 @@ Copyright © 2020 Vernon Mauery; All rights reserved.
 
 SPDX-License-Identifier: BSD-3-Clause
 */
+#include <algorithm>
 #include <cmath>
 #include <function.hpp>
 #include <functions/common.hpp>
+#include <optional>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
@@ -101,6 +104,154 @@ bool inverse_from_stack(Calculator& calc)
            });
 }
 
+namespace
+{
+
+// combine the values with op in a balanced tree: neighbors first, then
+// neighboring results and so on; the combinations on one level are
+// independent, so levels with enough of them are spread over the workers
+template <typename Op>
+mpx tree_reduce(std::vector<mpx>&& values, const Op& op, size_t min_chunk)
+{
+    size_t count = values.size();
+    for (size_t step = 1; step < count; step *= 2)
+    {
+        size_t pairs = (count + 2 * step - 1) / (2 * step);
+        worker_pool::get().parallel_for(
+            pairs,
+            [&values, &op, count, step](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; k++)
+                {
+                    size_t i = 2 * step * k;
+                    if (i + step < count)
+                    {
+                        values[i] = op(values[i], values[i + step]);
+                    }
+                }
+            },
+            min_chunk);
+    }
+    return std::move(values[0]);
+}
+
+// the values of the bottom count entries, deepest first, if they are all
+// plain numbers in the same units; anything else takes the slow path
+std::optional<std::vector<mpx>> stack_numbers(Calculator& calc,
+                                              size_t count)
+{
+    const units::unit& u = calc.stack[0].unit();
+    std::vector<mpx> values(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const stack_entry& e = calc.stack[count - 1 - i];
+        if (e.unit() != u || !reduce(e.value(), values[i])())
+        {
+            return std::nullopt;
+        }
+    }
+    return values;
+}
+
+// replace the bottom count entries with v, as precise as the least
+// precise of them
+void replace_on_stack(Calculator& calc, size_t count, mpx&& v,
+                      const units::unit& u)
+{
+    int precision = calc.stack[0].precision;
+    for (size_t i = 0; i < count; i++)
+    {
+        precision = std::min(precision, calc.stack.front().precision);
+        calc.stack.pop_front();
+    }
+    std::visit(
+        [&](auto&& v) {
+            calc.stack.emplace_front(numeric{std::move(v)}, u,
+                                     calc.config.base, calc.config.fixed_bits,
+                                     precision, calc.config.is_signed,
+                                     calc.flags);
+        },
+        std::move(v));
+}
+
+} // namespace
+
+mpx sum_tree(std::vector<mpx>&& values)
+{
+    if (values.empty())
+    {
+        return mpz{0};
+    }
+    // additions are cheap; only long levels are worth handing out
+    return tree_reduce(
+        std::move(values),
+        [](const mpx& a, const mpx& b) { return a + b; }, 1024);
+}
+
+mpx product_tree(std::vector<mpx>&& values)
+{
+    if (values.empty())
+    {
+        return mpz{1};
+    }
+    if (std::ranges::all_of(values, [](const mpx& v) {
+            return std::holds_alternative<mpz>(v);
+        }))
+    {
+        // integer products grow, so even the top levels are worth sharing
+        std::vector<mpz> factors{};
+        factors.reserve(values.size());
+        for (auto& v : values)
+        {
+            factors.push_back(std::move(std::get<mpz>(v)));
+        }
+        return product_tree(std::move(factors));
+    }
+    return tree_reduce(
+        std::move(values),
+        [](const mpx& a, const mpx& b) { return a * b; }, 64);
+}
+
+bool add_n_from_stack(Calculator& calc, size_t count)
+{
+    auto values = stack_numbers(calc, count);
+    if (!values)
+    {
+        // times, matrices, symbolics and unit conversions
+        for (; count > 1; count--)
+        {
+            add_from_stack(calc);
+        }
+        return true;
+    }
+    units::unit u = calc.stack[0].unit();
+    replace_on_stack(calc, count, sum_tree(std::move(*values)), u);
+    return true;
+}
+
+bool multiply_n_from_stack(Calculator& calc, size_t count)
+{
+    auto values = stack_numbers(calc, count);
+    if (!values)
+    {
+        for (; count > 1; count--)
+        {
+            multiply_from_stack(calc);
+        }
+        return true;
+    }
+    units::unit u = calc.stack[0].unit();
+    if (u != units::unit())
+    {
+        units::unit each = u;
+        for (size_t i = 1; i < count; i++)
+        {
+            u = u * each;
+        }
+    }
+    replace_on_stack(calc, count, product_tree(std::move(*values)), u);
+    return true;
+}
+
 } // namespace util
 
 struct add : public CalcFunction
@@ -421,7 +421,7 @@ struct equal : public CalcFunction
     virtual bool op(Calculator& calc) const final
     {
         // TODO: add support for more types (matrix, list, time_)
-        return two_arg_limited_op<bool, mpz, mpq, mpf, mpc>(
+        return two_arg_limited_op<bool, mpz, mpq, mpf, mpc, symbolic>(
             calc,
             [](const auto& a, const auto& b, const units::unit& ua,
                const units::unit& ub) -> std::tuple<numeric, units::unit> {
@@ -429,7 +429,18 @@ struct equal : public CalcFunction
                 {
                     throw units_mismatch();
                 }
-                return {a == b, ua};
+                using a_type = std::decay_t<decltype(a)>;
+                using b_type = std::decay_t<decltype(b)>;
+                if constexpr (std::is_same_v<a_type, symbolic> !=
+                              std::is_same_v<b_type, symbolic>)
+                {
+                    throw std::invalid_argument("Invalid argument type");
+                }
+                else
+                {
+                    // symbolics are interned, so this is a pointer compare
+                    return {a == b, ua};
+                }
             });
     }
     int num_args() const final
@@ -469,7 +480,7 @@ struct not_equal : public CalcFunction
     virtual bool op(Calculator& calc) const final
     {
         // TODO: add support for more types (matrix, list, time_)
-        return two_arg_limited_op<bool, mpz, mpq, mpf, mpc>(
+        return two_arg_limited_op<bool, mpz, mpq, mpf, mpc, symbolic>(
             calc,
             [](const auto& a, const auto& b, const units::unit& ua,
                const units::unit& ub) -> std::tuple<numeric, units::unit> {
@@ -477,7 +488,18 @@ struct not_equal : public CalcFunction
                 {
                     throw units_mismatch();
                 }
-                return {a != b, ua};
+                using a_type = std::decay_t<decltype(a)>;
+                using b_type = std::decay_t<decltype(b)>;
+                if constexpr (std::is_same_v<a_type, symbolic> !=
+                              std::is_same_v<b_type, symbolic>)
+                {
+                    throw std::invalid_argument("Invalid argument type");
+                }
+                else
+                {
+                    // symbolics are interned, so this is a pointer compare
+                    return {a != b, ua};
+                }
             });
     }
     int num_args() const final
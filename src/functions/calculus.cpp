@@ -0,0 +1,498 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+#include <algorithm>
+#include <cmath>
+#include <function.hpp>
+#include <limits>
+#include <optional>
+#include <ui.hpp>
+#include <worker_pool.hpp>
+
+namespace smrty
+{
+namespace function
+{
+
+namespace util
+{
+
+/*
+ * f(x) for a symbolic in one variable, needed to the given number of
+ * digits. It uses the double program when that is few enough and
+ * otherwise runs the symbolic's compiled tape in a private context, never
+ * the main stack. Copies share the compiled forms, but each copy forks its
+ * own context, so give each thread its own copy.
+ */
+class real_function
+{
+  public:
+    real_function(Calculator& calc, const symbolic& expr,
+                  const std::string& var, int digits) :
+        calc(calc), expr(expr), var(var), digits(digits)
+    {
+        if (calc.config.fixed_bits == 0 &&
+            digits <= std::numeric_limits<double>::digits10)
+        {
+            fast = expr.compile_double(calc, var);
+        }
+    }
+    real_function(const real_function& o) :
+        calc(o.calc), expr(o.expr), var(o.var), digits(o.digits),
+        fast(o.fast)
+    {
+    }
+
+    mpf operator()(const mpf& x)
+    {
+        if (fast)
+        {
+            double r = (*fast)(static_cast<double>(x));
+            if (std::isfinite(r))
+            {
+                return mpf{r};
+            }
+        }
+        if (!ctx)
+        {
+            ctx = calc.fork();
+            ctx->config.precision = digits;
+        }
+        Calculator::scoped_context scope(*ctx);
+        ctx->stack.clear();
+        ctx->set_var(var, numeric{x});
+        expr.eval(*ctx);
+        if (ctx->stack.size() != 1)
+        {
+            throw std::invalid_argument(
+                "expression must evaluate to a single value");
+        }
+        return std::visit(
+            [](const auto& v) -> mpf {
+                using v_type = std::decay_t<decltype(v)>;
+                if constexpr (std::is_same_v<v_type, mpz> ||
+                              std::is_same_v<v_type, mpq> ||
+                              std::is_same_v<v_type, mpf>)
+                {
+                    return static_cast<mpf>(v);
+                }
+                else
+                {
+                    throw std::invalid_argument(
+                        "expression must evaluate to a real number");
+                }
+            },
+            ctx->stack.front().value());
+    }
+
+  protected:
+    Calculator& calc;
+    const symbolic& expr;
+    const std::string& var;
+    int digits;
+    std::optional<symbolic_double_fn> fast;
+    std::unique_ptr<Calculator> ctx;
+};
+
+// fetch 'expr' 'v' a b from the stack without removing them
+static std::tuple<const symbolic&, const std::string&, mpf, mpf>
+    expression_and_interval(Calculator& calc)
+{
+    for (size_t i = 0; i < 4; i++)
+    {
+        if (calc.stack[i].unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+    }
+    auto expr = std::get_if<symbolic>(&calc.stack[3].value());
+    if (!expr)
+    {
+        throw std::invalid_argument("'x' must be a symbolic expression");
+    }
+    auto var = std::get_if<symbolic>(&calc.stack[2].value());
+    const std::string* var_name = nullptr;
+    if (var && (**var).fn_ptr == invalid_function)
+    {
+        var_name = std::get_if<std::string>(&(**var).left);
+    }
+    if (!var_name)
+    {
+        throw std::invalid_argument("'y' must be a variable name");
+    }
+    auto bound = [](const numeric& v) {
+        return std::visit(
+            [](const auto& b) -> mpf {
+                using b_type = std::decay_t<decltype(b)>;
+                if constexpr (std::is_same_v<b_type, mpz> ||
+                              std::is_same_v<b_type, mpq> ||
+                              std::is_same_v<b_type, mpf>)
+                {
+                    return static_cast<mpf>(b);
+                }
+                else
+                {
+                    throw std::invalid_argument(
+                        "the interval must be real numbers");
+                }
+            },
+            v);
+    };
+    return {*expr, *var_name, bound(calc.stack[1].value()),
+            bound(calc.stack[0].value())};
+}
+
+// works at a lower precision until it goes out of scope; work handed to
+// the worker pool meanwhile runs at that precision too
+class precision_scope
+{
+  public:
+    explicit precision_scope(int digits) : saved(default_precision)
+    {
+        set_thread_precision(digits);
+    }
+    ~precision_scope()
+    {
+        set_thread_precision(saved);
+    }
+    precision_scope(const precision_scope&) = delete;
+    precision_scope& operator=(const precision_scope&) = delete;
+
+  protected:
+    int saved;
+};
+
+// 10^-digits, the target accuracy for a given precision
+static mpf tolerance(int digits)
+{
+    return pow_fn(mpf{10}, mpf{-digits});
+}
+
+/*
+ * Brent's method: bisection, the secant method and inverse quadratic
+ * interpolation, keeping the root bracketed the whole time.
+ */
+static mpf brent_root(real_function& f, mpf a, mpf b, const mpf& tol)
+{
+    static constexpr int max_iterations = 1000;
+    mpf fa = f(a);
+    mpf fb = f(b);
+    if (fa == mpf{0})
+    {
+        return a;
+    }
+    if (fb == mpf{0})
+    {
+        return b;
+    }
+    if ((fa < mpf{0}) == (fb < mpf{0}))
+    {
+        throw std::invalid_argument(
+            "the expression must change sign over the interval");
+    }
+    if (abs_fn(fa) < abs_fn(fb))
+    {
+        std::swap(a, b);
+        std::swap(fa, fb);
+    }
+    mpf c = a;
+    mpf fc = fa;
+    mpf d = b - a;
+    bool bisected = true;
+    for (int i = 0; i < max_iterations; i++)
+    {
+        if (fb == mpf{0} || abs_fn(b - a) <= tol * (mpf{1} + abs_fn(b)))
+        {
+            return b;
+        }
+        mpf s;
+        if (fa != fc && fb != fc)
+        {
+            // inverse quadratic interpolation
+            s = a * fb * fc / ((fa - fb) * (fa - fc)) +
+                b * fa * fc / ((fb - fa) * (fb - fc)) +
+                c * fa * fb / ((fc - fa) * (fc - fb));
+        }
+        else
+        {
+            // secant
+            s = b - fb * (b - a) / (fb - fa);
+        }
+        mpf lo = (mpf{3} * a + b) / mpf{4};
+        bool outside = (s < lo && s < b) || (s > lo && s > b);
+        if (outside ||
+            (bisected && abs_fn(s - b) >= abs_fn(b - c) / mpf{2}) ||
+            (!bisected && abs_fn(s - b) >= abs_fn(c - d) / mpf{2}))
+        {
+            s = (a + b) / mpf{2};
+            bisected = true;
+        }
+        else
+        {
+            bisected = false;
+        }
+        mpf fs = f(s);
+        d = c;
+        c = b;
+        fc = fb;
+        if ((fa < mpf{0}) != (fs < mpf{0}))
+        {
+            b = s;
+            fb = fs;
+        }
+        else
+        {
+            a = s;
+            fa = fs;
+        }
+        if (abs_fn(fa) < abs_fn(fb))
+        {
+            std::swap(a, b);
+            std::swap(fa, fb);
+        }
+    }
+    throw std::runtime_error("solve did not converge");
+}
+
+/*
+ * Adaptive Simpson's rule over [a, b] with Richardson correction. Pieces
+ * that have not converged are split, using an explicit list rather than
+ * recursion. Returns the estimate and whether it met the tolerance.
+ */
+static std::tuple<mpf, bool> adaptive_simpson(real_function& f, const mpf& a,
+                                              const mpf& b, const mpf& tol)
+{
+    static constexpr int max_depth = 48;
+    static constexpr size_t max_evaluations = 1'000'000;
+    struct piece
+    {
+        mpf a, m, b;
+        mpf fa, fm, fb;
+        mpf whole;
+        mpf tol;
+        int depth;
+    };
+    auto simpson = [](const mpf& a, const mpf& b, const mpf& fa,
+                      const mpf& fm, const mpf& fb) {
+        return (b - a) / mpf{6} * (fa + mpf{4} * fm + fb);
+    };
+    mpf m = (a + b) / mpf{2};
+    mpf fa = f(a);
+    mpf fm = f(m);
+    mpf fb = f(b);
+    std::vector<piece> work{
+        {a, m, b, fa, fm, fb, simpson(a, b, fa, fm, fb), tol, 0}};
+    size_t evaluations = 3;
+    bool converged = true;
+    mpf total{0};
+    while (work.size())
+    {
+        piece p = std::move(work.back());
+        work.pop_back();
+        mpf lm = (p.a + p.m) / mpf{2};
+        mpf rm = (p.m + p.b) / mpf{2};
+        mpf flm = f(lm);
+        mpf frm = f(rm);
+        evaluations += 2;
+        mpf left = simpson(p.a, p.m, p.fa, flm, p.fm);
+        mpf right = simpson(p.m, p.b, p.fm, frm, p.fb);
+        mpf delta = left + right - p.whole;
+        if (abs_fn(delta) <= mpf{15} * p.tol || p.depth >= max_depth ||
+            evaluations >= max_evaluations)
+        {
+            if (abs_fn(delta) > mpf{15} * p.tol)
+            {
+                converged = false;
+            }
+            total += left + right + delta / mpf{15};
+            continue;
+        }
+        mpf half_tol = p.tol / mpf{2};
+        work.push_back(
+            {p.m, rm, p.b, p.fm, frm, p.fb, right, half_tol, p.depth + 1});
+        work.push_back(
+            {p.a, lm, p.m, p.fa, flm, p.fm, left, half_tol, p.depth + 1});
+    }
+    return {total, converged};
+}
+
+} // namespace util
+
+struct solve : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"solve"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: 'expr' 'v' a b solve\n"
+            "\n"
+            "    Returns a value of v in [a,b] where the symbolic\n"
+            "    expression is zero, e.g. 'x^2-2' 'x' 0 2 solve\n"
+            "    The expression must change sign between a and b. Uses\n"
+            "    Brent's method, which keeps the root bracketed.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // four args using num_args
+        auto [expr, var, a, b] = util::expression_and_interval(calc);
+        if (a == b)
+        {
+            throw std::invalid_argument("the interval must not be empty");
+        }
+        util::real_function f(calc, expr, var, calc.config.precision);
+        mpf tol = util::tolerance(calc.config.precision);
+        mpf root = util::brent_root(f, a, b, tol);
+        for (int i = 0; i < 4; i++)
+        {
+            calc.stack.pop_front();
+        }
+        calc.stack.emplace_front(std::move(root), calc.config.base,
+                                 calc.config.fixed_bits, calc.config.precision,
+                                 calc.config.is_signed, calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 4;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct integrate : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"integrate"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: 'expr' 'v' a b integrate\n"
+            "\n"
+            "    Returns the definite integral of the symbolic expression\n"
+            "    over v from a to b, e.g. 'sin(x)' 'x' 0 pi integrate\n"
+            "    Uses adaptive Simpson's rule on pieces of the interval\n"
+            "    that are worked on in parallel. Accuracy is limited to\n"
+            "    about 15 digits at any precision.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // four args using num_args
+        auto [expr, var, a, b] = util::expression_and_interval(calc);
+        // simpson's error only falls as h^4, so more digits than a double
+        // holds would take far too many evaluations
+        int digits = std::min(calc.config.precision,
+                              std::numeric_limits<double>::digits10);
+        // no step needs more digits than the result can show
+        util::precision_scope scope(digits);
+        util::real_function f(calc, expr, var, digits);
+
+        // split the interval so every thread has a few pieces to work on
+        int pieces = static_cast<int>(worker_pool::get().concurrency()) * 4;
+        mpf step = (b - a) / mpf{pieces};
+        auto bounds = [&](size_t i) -> std::tuple<mpf, mpf> {
+            int n = static_cast<int>(i);
+            mpf lo = a + step * mpf{n};
+            mpf hi = (n + 1 == pieces) ? b : a + step * mpf{n + 1};
+            return {lo, hi};
+        };
+        // the tolerance is relative to a coarse estimate of the integral
+        // of |f|, so large and small integrals get the same number of
+        // correct digits; a zero estimate falls back to an absolute one
+        std::vector<mpf> coarse(pieces);
+        worker_pool::get().parallel_for(
+            pieces, [&](size_t begin, size_t end) {
+                util::real_function fp{f};
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto [lo, hi] = bounds(i);
+                    mpf mid = (lo + hi) / mpf{2};
+                    coarse[i] = abs_fn(hi - lo) / mpf{6} *
+                                (abs_fn(fp(lo)) + mpf{4} * abs_fn(fp(mid)) +
+                                 abs_fn(fp(hi)));
+                }
+            });
+        mpf scale{0};
+        for (const auto& c : coarse)
+        {
+            scale += c;
+        }
+        mpf tol = util::tolerance(digits);
+        tol = tol * (scale > mpf{0} ? scale : tol) / mpf{pieces};
+        std::vector<mpf> partial(pieces);
+        std::vector<char> converged(pieces);
+        worker_pool::get().parallel_for(
+            pieces, [&](size_t begin, size_t end) {
+                util::real_function fp{f};
+                for (size_t i = begin; i < end; i++)
+                {
+                    auto [lo, hi] = bounds(i);
+                    auto [v, ok] = util::adaptive_simpson(fp, lo, hi, tol);
+                    partial[i] = std::move(v);
+                    converged[i] = ok;
+                }
+            });
+        mpf total{0};
+        for (const auto& p : partial)
+        {
+            total += p;
+        }
+        if (std::find(converged.begin(), converged.end(), 0) !=
+            converged.end())
+        {
+            ui::get()->err("integrate: warning: the result did not converge "
+                           "and may be inaccurate\n");
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            calc.stack.pop_front();
+        }
+        // only show the digits that the integration can deliver
+        calc.stack.emplace_front(std::move(total), calc.config.base,
+                                 calc.config.fixed_bits, digits,
+                                 calc.config.is_signed, calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 4;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+} // namespace function
+} // namespace smrty
+
+register_calc_fn(solve);
+register_calc_fn(integrate);
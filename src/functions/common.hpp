@@ -25,6 +25,11 @@ bool divide_from_stack(Calculator& calc);
 bool inverse_from_stack(Calculator& calc);
 bool power_from_stack(Calculator& calc);
 
+// replace the bottom count (>= 1) items on the stack with their sum or
+// product, combined pairwise in a balanced tree
+bool add_n_from_stack(Calculator& calc, size_t count);
+bool multiply_n_from_stack(Calculator& calc, size_t count);
+
 numeric power_direct(const auto& a, const auto& b)
 {
     if constexpr (same_type_v<decltype(a), mpz> &&
@@ -62,14 +67,45 @@ numeric power_direct(const auto& a, const auto& b)
     }
 }
 
+// run prog on calc's stack in a new variable scope
+void run_program(Calculator& calc, const program& prog);
+
+// run prog on calc with args pushed in order (last arg on the bottom of the
+// stack) and return the single value that it leaves behind
+numeric apply_program(Calculator& calc, const program& prog,
+                      std::vector<numeric>&& args);
+
+// all primes <= n in increasing order; the primes below 2^26 are sieved
+// once and kept for the rest of the session
+std::vector<unsigned long> primes_up_to(unsigned long n);
+
+// all primes in [lo, hi] in increasing order
+std::vector<unsigned long> primes_between(unsigned long lo, unsigned long hi);
+
+// the product of all the factors, multiplied in a balanced tree
+mpz product_tree(std::vector<mpz>&& factors);
+mpx product_tree(std::vector<mpx>&& values);
+mpx sum_tree(std::vector<mpx>&& values);
+
 mpz factorial(const mpz&);
 
+// x! / (y! * (x - y)!) and x! / (x - y)! for 0 <= y <= x, computed
+// without forming the factorials
 mpz comb(const mpz& x, const mpz& y);
-
 mpz perm(const mpz& x, const mpz& y);
 
 std::vector<mpz> factor_mpz(const mpz& x);
 
+// (a * b) mod m, (b ^ e) mod m and the inverse of a mod m (0 if a has no
+// inverse); the arguments must already be reduced mod m
+mpz mulmod(const mpz& a, const mpz& b, const mpz& m);
+mpz powm(const mpz& b, const mpz& e, const mpz& m);
+mpz invert(const mpz& a, const mpz& m);
+
+// probable prime test (exact below 3.3e24)
+bool is_prime(const mpz& n);
+
+// the prime factors of x in increasing order, with repeats
 std::vector<mpz> prime_factor(mpz x);
 
 } // namespace util
@@ -3,8 +3,15 @@ Copyright © 2020 Vernon Mauery; All rights reserved.
 
 SPDX-License-Identifier: BSD-3-Clause
 */
+#include <array>
 #include <exception>
 #include <function.hpp>
+#include <functions/common.hpp>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
@@ -14,28 +21,74 @@ namespace function
 namespace util
 {
 
-mpz bin_split_factorial(const mpz& a, const mpz& b)
+mpz product_tree(std::vector<mpz>&& factors)
 {
-    mpz d = a - b;
-    if (d <= 0)
-        return 1;
-    if (d < 4)
+    if (factors.empty())
+    {
+        return one;
+    }
+    // multiply neighbors pairwise, level by level, so each multiplication
+    // is of two similarly sized numbers; the products on one level are
+    // independent of each other, so they are spread over the workers
+    size_t count = factors.size();
+    for (size_t step = 1; step < count; step *= 2)
     {
-        if (d == one)
+        size_t pairs = (count + 2 * step - 1) / (2 * step);
+        worker_pool::get().parallel_for(
+            pairs, [&factors, count, step](size_t begin, size_t end) {
+                for (size_t k = begin; k < end; k++)
+                {
+                    size_t i = 2 * step * k;
+                    if (i + step < count)
+                    {
+                        factors[i] *= factors[i + step];
+                        factors[i + step] = zero;
+                    }
+                }
+            });
+    }
+    return std::move(factors[0]);
+}
+
+#if !defined(USE_GMP_BACKEND) && !defined(USE_MPFR_BACKEND)
+// swing(n) = n! / (floor(n/2)!)^2, computed from its prime factorization
+// (Luschny's prime swing); every prime power in it is <= n
+mpz prime_swing(unsigned long n, const std::vector<unsigned long>& primes)
+{
+    std::vector<mpz> factors{};
+    for (auto p : primes)
+    {
+        if (p > n)
+        {
+            break;
+        }
+        unsigned long pe = 1;
+        for (unsigned long q = n / p; q > 0; q /= p)
         {
-            return a;
+            if (q & 1)
+            {
+                pe *= p;
+            }
         }
-        if (d == two)
+        if (pe > 1)
         {
-            return a * (a - one);
+            factors.emplace_back(pe);
         }
-        // d == 3
-        return a * (a - one) * (a - two);
     }
-    // all other values >= 4
-    mpz m = (a + b) / two;
-    return bin_split_factorial(a, m) * bin_split_factorial(m, b);
+    return product_tree(std::move(factors));
+}
+
+mpz prime_swing_factorial(unsigned long n,
+                          const std::vector<unsigned long>& primes)
+{
+    if (n < 2)
+    {
+        return one;
+    }
+    mpz f = prime_swing_factorial(n / 2, primes);
+    return f * f * prime_swing(n, primes);
 }
+#endif
 
 mpz factorial(const mpz& x)
 {
@@ -47,7 +100,19 @@ mpz factorial(const mpz& x)
     {
         return one;
     }
-    return bin_split_factorial(x, zero);
+    if (x > mpz{std::numeric_limits<long>::max()})
+    {
+        throw std::range_error("x is too large");
+    }
+    auto n = static_cast<unsigned long>(x);
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    // gmp already has an optimized prime swing factorial
+    mpz f{};
+    mpz_fac_ui(f.backend().data(), n);
+    return f;
+#else
+    return prime_swing_factorial(n, primes_up_to(n));
+#endif
 }
 
 mpf factorial(const mpf& x)
@@ -68,7 +133,44 @@ symbolic factorial(const symbolic& x)
     return smrty::factorial(x);
 }
 
-mpc gamma_mpc(const mpc& zp)
+// Spouge's coefficients only depend on the precision, so they are computed
+// (in parallel) the first time a precision is used and kept for later
+std::shared_ptr<const std::vector<mpf>> spouge_coefficients(int prec, int a)
+{
+    static std::mutex lock;
+    static std::map<int, std::shared_ptr<const std::vector<mpf>>> cache;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (auto c = cache.find(prec); c != cache.end())
+        {
+            return c->second;
+        }
+    }
+    // c0 = sqrt(2pi)
+    // cn = (-1)^(n-1) / (n-1)! * (a-n)^(n-1/2) * e^(a-n), for 0 < n < a
+    auto coeffs = std::make_shared<std::vector<mpf>>(a);
+    worker_pool::get().parallel_for(
+        a, [&coeffs, a](size_t begin, size_t end) {
+            const mpf half{0.5l};
+            for (size_t n = begin; n < end; n++)
+            {
+                if (n == 0)
+                {
+                    const mpf pi{get_constant(math_constant::pi)};
+                    (*coeffs)[0] = sqrt_fn(mpf{2} * pi);
+                    continue;
+                }
+                mpf an{a - static_cast<int>(n)};
+                mpf cn = pow_fn(an, mpf{mpz{n}} - half) * exp_fn(an) /
+                         mpf{factorial(mpz{n - 1})};
+                (*coeffs)[n] = (n % 2) ? cn : mpf{-cn};
+            }
+        });
+    std::lock_guard<std::mutex> guard(lock);
+    return cache.try_emplace(prec, std::move(coeffs)).first->second;
+}
+
+mpc gamma_spouge(const mpc& zp)
 {
     // using Spouge's approximation
     // gamma(z+1) = (z+a)^(z+1/2)*e^(-z-a)*(c0 + sum(1,a-1,cn/(z+n)))
@@ -76,31 +178,55 @@ mpc gamma_mpc(const mpc& zp)
     auto prec = default_precision;
     set_default_precision(prec * 5 / 4);
 
-    // it would be possible to pre-calculate cn for any given precision
-    // but this is already incredibly fast
-
     const mpf half{0.5l};
-    const mpz one{1};
-    const mpf two{2.0l};
-    const mpf pi{boost::math::constants::pi<mpf>()};
-    const mpz a{default_precision};
+    const int a{default_precision};
+    auto coeffs = spouge_coefficients(prec, a);
     const mpc z{zp - mpc{1}};
-    mpc g{pow_fn(z + a, z + half) * exp_fn(-z - a)};
-    mpc cn{sqrt_fn(two * pi)};
-    mpc sum{cn};
-    mpf sign{-1};
-    for (mpz n = mpz{1}; n < a; n++)
+    mpc g{pow_fn(z + mpc{a}, z + half) * exp_fn(-z - mpc{a})};
+    mpc sum{(*coeffs)[0]};
+    for (int n = 1; n < a; n++)
     {
-        sign = -sign;
-        cn = (sign / mpf{factorial(n - one)}) * pow_fn(mpf{-n + a}, n - half) *
-             exp_fn(mpf{-n + a});
-        sum += cn / (z + n);
+        sum += mpc{(*coeffs)[n]} / (z + mpc{n});
     }
     g *= sum;
     set_default_precision(prec);
     return g;
 }
 
+// Lanczos' approximation with g = 7 is good to about 15 digits
+mpc gamma_lanczos(const mpc& zp)
+{
+    static constexpr std::array<long double, 9> p{
+        0.99999999999980993l,  676.5203681218851l,     -1259.1392167224028l,
+        771.32342877765313l,   -176.61502916214059l,   12.507343278686905l,
+        -0.13857109526572012l, 9.9843695780195716e-6l, 1.5056327351493116e-7l,
+    };
+    const mpf pi{get_constant(math_constant::pi)};
+    if (zp.real() < mpf{0.5l})
+    {
+        // reflection: gamma(z) * gamma(1-z) = pi / sin(pi*z)
+        return mpc{pi} / (sin_fn(mpc{pi} * zp) * gamma_lanczos(mpc{1} - zp));
+    }
+    const mpc z{zp - mpc{1}};
+    mpc x{p[0]};
+    for (size_t i = 1; i < p.size(); i++)
+    {
+        x += mpc{p[i]} / (z + mpc{static_cast<int>(i)});
+    }
+    mpc t = z + mpc{7.5l};
+    return mpc{sqrt_fn(mpf{2} * pi)} * pow_fn(t, z + mpc{0.5l}) * exp_fn(-t) *
+           x;
+}
+
+mpc gamma_mpc(const mpc& z)
+{
+    if (default_precision <= 15)
+    {
+        return gamma_lanczos(z);
+    }
+    return gamma_spouge(z);
+}
+
 mpc factorial(const mpc& x)
 {
     // non-int types get gamma treatment
@@ -142,18 +268,33 @@ symbolic zeta(const symbolic& x)
     return zeta_fn(x);
 }
 
-mpc d_kn(const mpz& k, const mpz& n)
+// Borwein's d_k = n * sum(i=0..k, (n+i-1)! * 4^i / ((n-i)! * (2i)!)) for
+// 0 <= k <= n; the terms are integers and each follows from the last:
+// t(i+1) = t(i) * 2(n+i)(n-i) / ((i+1)(2i+1)). They only depend on n, so
+// they are kept for the next call with the same n.
+std::shared_ptr<const std::vector<mpz>> borwein_d(unsigned long n)
 {
-    mpz sum{0};
-    mpz one{1};
-    mpz two{2};
-    for (mpz i = 0; i < (k + one); i++)
+    static std::mutex lock;
+    static std::map<unsigned long, std::shared_ptr<const std::vector<mpz>>>
+        cache;
+    std::lock_guard<std::mutex> guard(lock);
+    if (auto c = cache.find(n); c != cache.end())
     {
-        mpz four_pow_i = one << (2 * static_cast<long long>(i));
-        sum += (factorial(n + i - one) * four_pow_i) /
-               (factorial(n - i) * factorial(two * i));
+        return c->second;
     }
-    return mpc{mpf{n * sum}};
+    auto d = std::make_shared<std::vector<mpz>>();
+    d->reserve(n + 1);
+    mpz term{1};
+    mpz sum{1};
+    d->push_back(sum);
+    for (unsigned long i = 0; i < n; i++)
+    {
+        term *= mpz{2 * (n + i)} * mpz{n - i};
+        term /= mpz{(i + 1) * (2 * i + 1)};
+        sum += term;
+        d->push_back(sum);
+    }
+    return cache.try_emplace(n, std::move(d)).first->second;
 }
 
 mpc zeta(const mpc& x)
@@ -167,21 +308,42 @@ mpc zeta(const mpc& x)
     set_default_precision(prec * 1.1);
 
     // n = ceil(log[base(3+sqrt(8))](1.36*10^prec/abs((1-2^(1-x))*gamma(x))))
-    auto n = static_cast<mpz>(
+    auto n = static_cast<unsigned long>(static_cast<mpz>(
         ceil_fn(
             log_fn(mpf{1.36} * pow_fn(mpf{10}, prec) /
                    abs_fn((mpc{1} - pow_fn(mpc{2}, mpc{1} - x)) * gamma(x)))) /
-        log_fn(mpf{3} + sqrt_fn(mpf{8})));
+        log_fn(mpf{3} + sqrt_fn(mpf{8}))));
     lg::debug("zeta using {} iterations\n", n);
 
+    auto d = borwein_d(n);
+    const mpc dn{mpf{(*d)[n]}};
+    // sum(k=0..n-1, (-1)^k * (d_k - d_n) / (k+1)^x) in parallel runs; each
+    // run's sum is stored at the index where the run starts
+    std::vector<mpc> partial(n);
+    worker_pool::get().parallel_for(
+        n,
+        [&d, &dn, &x, &partial](size_t begin, size_t end) {
+            mpc sum{0};
+            for (size_t k = begin; k < end; k++)
+            {
+                mpc t = (mpc{mpf{(*d)[k]}} - dn) /
+                        pow_fn(mpc{static_cast<int>(k + 1)}, x);
+                if (k % 2)
+                {
+                    sum -= t;
+                }
+                else
+                {
+                    sum += t;
+                }
+            }
+            partial[begin] = sum;
+        },
+        16);
     mpc sum{0};
-    mpz one{1};
-    mpc sign{1};
-    mpc dn = d_kn(n, n);
-    for (mpz k = 0; k < n; k++)
+    for (const auto& p : partial)
     {
-        sum += sign * (d_kn(k, n) - dn) / pow_fn(mpc{k + one}, x);
-        sign = -sign;
+        sum += p;
     }
     // final product
     mpc prefix = -dn * (mpc{1} - pow_fn(mpc{2}, (mpc{1} - x)));
@@ -607,7 +607,7 @@ struct hyperbolic_arccotangent : public CalcFunction
                    return scaled_trig_op_inv(calc, a, [](const auto& a) {
                        if constexpr (same_type_v<decltype(a), mpf>)
                        {
-                           auto pi = boost::math::constants::pi<mpf>();
+                           auto pi = get_constant(math_constant::pi);
                            if (a > decltype(a){0})
                            {
                                return atanh_fn(mpf{1} / a);
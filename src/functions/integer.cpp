@@ -3,8 +3,17 @@ Copyright © 2020 Vernon Mauery; All rights reserved.
 
 SPDX-License-Identifier: BSD-3-Clause
 */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cmath>
 #include <function.hpp>
+#include <functions/common.hpp>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
@@ -13,63 +22,532 @@ namespace function
 namespace util
 {
 
-std::vector<mpz> factor_mpz(const mpz& x)
+mpz mulmod(const mpz& a, const mpz& b, const mpz& m)
 {
-    std::vector<mpz> facts;
-    mpz maxf = static_cast<mpz>(ceil_fn(sqrt(mpf(x))));
-    mpz n{2};
-    while (n < maxf)
+#ifdef USE_BASIC_TYPES
+    // the product needs twice the bits of the operands
+    __int128 p = static_cast<__int128>(static_cast<long long>(a)) *
+                 static_cast<long long>(b);
+    return mpz{static_cast<long long>(p % static_cast<long long>(m))};
+#else
+    return (a * b) % m;
+#endif
+}
+
+mpz powm(const mpz& b, const mpz& e, const mpz& m)
+{
+#ifdef USE_BASIC_TYPES
+    mpz result{1};
+    mpz base = b % m;
+    for (mpz n = e; n > zero; n /= two)
     {
-        if (x % n == 0)
+        if (n % two == one)
         {
-            facts.push_back(n);
-            facts.push_back(x / n);
+            result = mulmod(result, base, m);
         }
-        n++;
+        base = mulmod(base, base, m);
     }
-    std::sort(facts.begin(), facts.end());
-    return facts;
+    return result % m;
+#else
+    return boost::multiprecision::powm(b, e, m);
+#endif
+}
+
+mpz invert(const mpz& a, const mpz& m)
+{
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    mpz r{};
+    if (!mpz_invert(r.backend().data(), a.backend().data(), m.backend().data()))
+    {
+        return zero;
+    }
+    return r;
+#else
+    // extended Euclid, only tracking the coefficient of a
+    mpz r0 = m, r1 = a % m;
+    mpz t0{0}, t1{1};
+    if (r1 < zero)
+    {
+        r1 += m;
+    }
+    while (r1 != zero)
+    {
+        mpz q = r0 / r1;
+        mpz r2 = r0 - q * r1;
+        r0 = std::move(r1);
+        r1 = std::move(r2);
+        mpz t2 = t0 - q * t1;
+        t0 = std::move(t1);
+        t1 = std::move(t2);
+    }
+    if (r0 != one)
+    {
+        return zero;
+    }
+    return t0 < zero ? mpz{t0 + m} : t0;
+#endif
+}
+
+bool is_prime(const mpz& n)
+{
+    if (n < two)
+    {
+        return false;
+    }
+    static constexpr std::array<unsigned int, 20> bases{
+        2,  3,  5,  7,  11, 13, 17, 19, 23, 29,
+        31, 37, 41, 43, 47, 53, 59, 61, 67, 71,
+    };
+    for (auto p : bases)
+    {
+        if (n == mpz{p})
+        {
+            return true;
+        }
+        if (n % mpz{p} == zero)
+        {
+            return false;
+        }
+    }
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    // a Baillie-PSW test followed by Miller-Rabin rounds
+    return mpz_probab_prime_p(n.backend().data(), 24) > 0;
+#else
+    // Miller-Rabin with the first 12 prime bases is exact for n < 3.3e24;
+    // the rest of the bases make a false positive above that unlikely
+    mpz n1 = n - one;
+    mpz d = n1;
+    unsigned int s = 0;
+    while (d % two == zero)
+    {
+        d /= two;
+        s++;
+    }
+    for (auto p : bases)
+    {
+        mpz x = powm(mpz{p}, d, n);
+        if (x == one || x == n1)
+        {
+            continue;
+        }
+        unsigned int r = 1;
+        for (; r < s; r++)
+        {
+            x = mulmod(x, x, n);
+            if (x == n1)
+            {
+                break;
+            }
+        }
+        if (r == s)
+        {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+namespace
+{
+
+// the primes used for trial division
+const std::vector<unsigned long>& small_primes()
+{
+    static const std::vector<unsigned long> primes = primes_up_to(1 << 16);
+    return primes;
+}
+
+mpz abs_diff(const mpz& a, const mpz& b)
+{
+    return a < b ? mpz{b - a} : mpz{a - b};
+}
+
+// Pollard's rho with Brent's cycle detection and batched gcds; returns a
+// non-trivial factor of n or 0 if none was found in max_iter steps
+mpz pollard_brent(const mpz& n, const mpz& c, size_t max_iter)
+{
+    constexpr size_t batch = 128;
+    auto f = [&n, &c](const mpz& v) { return (mulmod(v, v, n) + c) % n; };
+    mpz x{}, ys{}, y{2}, q{1}, g{1};
+    for (size_t r = 1; g == one; r *= 2)
+    {
+        if (r > max_iter)
+        {
+            return zero;
+        }
+        x = y;
+        for (size_t i = 0; i < r; i++)
+        {
+            y = f(y);
+        }
+        for (size_t k = 0; k < r && g == one; k += batch)
+        {
+            ys = y;
+            for (size_t i = 0; i < std::min(batch, r - k); i++)
+            {
+                y = f(y);
+                q = mulmod(q, abs_diff(x, y), n);
+            }
+            g = gcd_fn(q, n);
+        }
+    }
+    if (g == n)
+    {
+        // the batch overshot; step through it one at a time
+        do
+        {
+            ys = f(ys);
+            g = gcd_fn(abs_diff(x, ys), n);
+        } while (g == one);
+    }
+    return g == n ? zero : g;
+}
+
+#ifndef USE_BASIC_TYPES
+// Lenstra's elliptic curve method on Montgomery curves By^2 = x^3 + Ax^2 + x
+// using only x and z coordinates
+class ecm_curve
+{
+  public:
+    struct point
+    {
+        mpz x;
+        mpz z;
+    };
+
+    ecm_curve(const mpz& n) : n(n)
+    {
+    }
+
+    // Suyama's parametrization; returns a factor if one shows up while
+    // setting up the curve, 0 otherwise
+    mpz init(unsigned long sigma)
+    {
+        mpz s{sigma};
+        mpz u = mod(s * s - 5);
+        mpz v = mod(s * 4);
+        mpz u3 = mod(u * u * u);
+        start = point{u3, mod(v * v * v)};
+        mpz den = mod(u3 * v * 16);
+        mpz inv = invert(den, n);
+        if (inv == zero)
+        {
+            mpz g = gcd_fn(den, n);
+            return g == n ? zero : g;
+        }
+        mpz vu = v - u;
+        a24 = mod(mod(vu * vu * vu) * mod(u * 3 + v));
+        a24 = mod(a24 * inv);
+        return zero;
+    }
+
+    // stage 1: multiply the start point by every prime power <= b1
+    // stage 2: look for one more prime in (b1, b2]
+    mpz run(unsigned long b1, unsigned long b2, const std::atomic<bool>& done)
+    {
+        point p = start;
+        for (auto q : primes_up_to(b1))
+        {
+            if (done)
+            {
+                return zero;
+            }
+            unsigned long qe = q;
+            while (qe <= b1 / q)
+            {
+                qe *= q;
+            }
+            p = multiply(qe, p);
+        }
+        mpz g = gcd_fn(p.z, n);
+        if (g != one)
+        {
+            return g == n ? zero : g;
+        }
+        return stage2(p, b1, b2, done);
+    }
+
+  protected:
+    mpz mod(const mpz& v) const
+    {
+        mpz r = v % n;
+        return r < zero ? mpz{r + n} : r;
+    }
+
+    point dbl(const point& p) const
+    {
+        mpz s = mod(p.x + p.z);
+        mpz d = mod(p.x - p.z);
+        s = mod(s * s);
+        d = mod(d * d);
+        mpz t = mod(s - d);
+        return point{mod(s * d), mod(t * mod(d + a24 * t))};
+    }
+
+    // p + q where diff = p - q
+    point add(const point& p, const point& q, const point& diff) const
+    {
+        mpz u = mod(mod(p.x - p.z) * mod(q.x + q.z));
+        mpz v = mod(mod(p.x + p.z) * mod(q.x - q.z));
+        mpz s = mod(u + v);
+        mpz d = mod(u - v);
+        return point{mod(diff.z * mod(s * s)), mod(diff.x * mod(d * d))};
+    }
+
+    // Montgomery ladder
+    point multiply(unsigned long k, const point& p) const
+    {
+        if (k == 1)
+        {
+            return p;
+        }
+        point r0 = p;
+        point r1 = dbl(p);
+        int bit = std::bit_width(k) - 2;
+        for (; bit >= 0; bit--)
+        {
+            if (k & (1ul << bit))
+            {
+                r0 = add(r1, r0, p);
+                r1 = dbl(r1);
+            }
+            else
+            {
+                r1 = add(r1, r0, p);
+                r0 = dbl(r0);
+            }
+        }
+        return r0;
+    }
+
+    // baby step, giant step: every prime in (b1, b2] is k*d +/- j for
+    // some odd j < d/2 that is coprime to d, and kdP = +/-jP exactly when
+    // x(kdP) * z(jP) - x(jP) * z(kdP) = 0 (mod p)
+    mpz stage2(const point& p, unsigned long b1, unsigned long b2,
+               const std::atomic<bool>& done)
+    {
+        constexpr unsigned long d = 210;
+        std::vector<point> baby{};
+        point p2 = dbl(p);
+        point prev = p;
+        point cur = add(p2, p, p);
+        baby.push_back(p);
+        for (unsigned long j = 3; j < d / 2; j += 2)
+        {
+            if (std::gcd(j, d) == 1)
+            {
+                baby.push_back(cur);
+            }
+            point next = add(cur, p2, prev);
+            prev = std::move(cur);
+            cur = std::move(next);
+        }
+        unsigned long k = std::max(b1 / d, 2ul);
+        point giant = multiply(d, p);
+        point last = multiply((k - 1) * d, p);
+        point r = multiply(k * d, p);
+        mpz acc{1};
+        for (; k * d <= b2 + d; k++)
+        {
+            if (done)
+            {
+                return zero;
+            }
+            for (const auto& s : baby)
+            {
+                acc = mod(acc * mod(r.x * s.z - s.x * r.z));
+            }
+            point next = add(r, giant, last);
+            last = std::move(r);
+            r = std::move(next);
+        }
+        mpz g = gcd_fn(acc, n);
+        return (g == one || g == n) ? zero : g;
+    }
+
+    const mpz& n;
+    mpz a24;
+    point start;
+};
+
+// run curves in parallel with growing bounds until one finds a factor
+mpz ecm_factor(const mpz& n)
+{
+    // the standard bounds and curve counts for factors of 15 to 35 digits
+    static constexpr std::array<std::pair<unsigned long, size_t>, 5>
+        schedule{{
+            {2000, 25},
+            {11000, 90},
+            {50000, 300},
+            {250000, 700},
+            {1000000, 1800},
+        }};
+    unsigned long sigma = 6;
+    for (const auto& [b1, curves] : schedule)
+    {
+        lg::debug("ecm: {} curves with B1={}\n", curves, b1);
+        std::atomic<bool> done{false};
+        std::mutex lock;
+        mpz found{0};
+        worker_pool::get().parallel_for(curves, [&, b1](size_t begin,
+                                                         size_t end) {
+            for (size_t i = begin; i < end && !done; i++)
+            {
+                ecm_curve curve(n);
+                mpz g = curve.init(sigma + i);
+                if (g == zero)
+                {
+                    g = curve.run(b1, b1 * 100, done);
+                }
+                if (g != zero)
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    found = g;
+                    done = true;
+                }
+            }
+        });
+        if (found != zero)
+        {
+            return found;
+        }
+        sigma += curves;
+    }
+    return zero;
 }
+#endif
 
-mpz next_factor(const mpz& x, mpz& n)
+// a non-trivial factor of the composite n
+mpz find_factor(const mpz& n)
 {
-    mpz maxf = static_cast<mpz>(ceil_fn(sqrt(mpf(x))));
-    while (n <= maxf)
+    if (n % two == zero)
+    {
+        return two;
+    }
+#ifdef USE_BASIC_TYPES
+    // rho finds factors of 64 bit numbers in about 2^16 steps, so these
+    // limits are only reached if something is badly wrong
+    for (mpz c{1}; c <= mpz{64}; c += one)
+    {
+        mpz f = pollard_brent(n, c, 1ul << 24);
+        if (f != zero)
+        {
+            return f;
+        }
+    }
+#else
+    // neither rho nor ecm is any good with squares
+    mpz r = sqrt(n);
+    if (r * r == n)
     {
-        if (x % n == 0)
+        return r;
+    }
+    // rho is the quickest for factors up to about 12 digits
+    for (mpz c{1}; c < 4; c++)
+    {
+        mpz f = pollard_brent(n, c, 1 << 20);
+        if (f != zero)
         {
-            return x / n;
+            return f;
         }
-        n++;
     }
-    return 0;
+    mpz f = ecm_factor(n);
+    if (f != zero)
+    {
+        return f;
+    }
+#endif
+    throw std::runtime_error(std::format("Unable to factor {}", n));
 }
 
+} // namespace
+
 std::vector<mpz> prime_factor(mpz x)
 {
+    if (x == zero)
+    {
+        throw std::invalid_argument("Every prime divides 0");
+    }
     std::vector<mpz> facts;
-    mpz maxf = static_cast<mpz>(ceil_fn(sqrt(mpf(x))));
-    mpz n(2);
-    while (n <= maxf)
+    if (x < zero)
     {
-        mpz nf = next_factor(x, n);
-        if (nf != 0)
+        facts.push_back(mpz{-1});
+        x = -x;
+    }
+    // trial division gets the small factors out of the way
+    for (auto p : small_primes())
+    {
+        mpz mp{p};
+        if (mp * mp > x)
+        {
+            break;
+        }
+        while (x % mp == zero)
         {
-            facts.push_back(n);
-            x = nf;
-            maxf = static_cast<mpz>(ceil_fn(sqrt(mpf(x))));
-            n = 1;
+            facts.push_back(mp);
+            x /= mp;
         }
-        else
+    }
+    // split up whatever is left until only primes remain
+    std::vector<mpz> composites{};
+    if (x > one)
+    {
+        composites.push_back(std::move(x));
+    }
+    while (composites.size())
+    {
+        mpz c = std::move(composites.back());
+        composites.pop_back();
+        if (is_prime(c))
         {
-            facts.push_back(x);
+            facts.push_back(std::move(c));
+            continue;
         }
-        n++;
+        mpz f = find_factor(c);
+        lg::debug("prime_factor: {} = {} * {}\n", c, f, c / f);
+        composites.push_back(c / f);
+        composites.push_back(std::move(f));
     }
     std::sort(facts.begin(), facts.end());
     return facts;
 }
 
+std::vector<mpz> factor_mpz(const mpz& x)
+{
+    if (x == zero)
+    {
+        throw std::invalid_argument("Every integer divides 0");
+    }
+    // every divisor is a product of prime powers p^i with 0 <= i <= e for
+    // each prime p^e of x; build them up one prime at a time
+    std::vector<mpz> divisors{one};
+    std::vector<mpz> primes = prime_factor(x < zero ? mpz{-x} : x);
+    for (size_t i = 0; i < primes.size();)
+    {
+        const mpz& p = primes[i];
+        size_t e = 0;
+        for (; i < primes.size() && primes[i] == p; i++)
+        {
+            e++;
+        }
+        size_t count = divisors.size();
+        divisors.reserve(count * (e + 1));
+        for (size_t j = 0; j < count * e; j++)
+        {
+            divisors.push_back(divisors[j] * p);
+        }
+    }
+    std::sort(divisors.begin(), divisors.end());
+    // 1 and x are not interesting
+    if (divisors.size() < 3)
+    {
+        return {};
+    }
+    return std::vector<mpz>(std::make_move_iterator(divisors.begin() + 1),
+                            std::make_move_iterator(divisors.end() - 1));
+}
+
 } // namespace util
 
 struct factor : public CalcFunction
@@ -87,6 +565,7 @@ struct factor : public CalcFunction
             "    Usage: x factor\n"
             "\n"
             "    Returns the factors of the bottom item on the stack\n"
+            "    (every divisor other than 1 and x) in increasing order\n"
             // clang-format on
         };
         return _help;
@@ -158,6 +637,10 @@ struct prime_factor : public CalcFunction
         {
             throw std::invalid_argument("Requires an integer");
         }
+        if (*v == zero)
+        {
+            throw std::invalid_argument("Every prime divides 0");
+        }
         calc.stack.pop_front();
         std::vector<mpz> facts = util::prime_factor(*v);
         for (const auto& f : facts)
@@ -0,0 +1,308 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+#include <function.hpp>
+#include <functions/common.hpp>
+#include <optional>
+#include <worker_pool.hpp>
+
+namespace smrty
+{
+namespace function
+{
+
+namespace util
+{
+
+// fetch the list and program arguments (x and y) without removing them
+static std::tuple<const list&, const program&>
+    list_and_program(Calculator& calc)
+{
+    stack_entry& a = calc.stack[1];
+    stack_entry& b = calc.stack[0];
+    if (a.unit() != units::unit() || b.unit() != units::unit())
+    {
+        throw units_prohibited();
+    }
+    auto lst = std::get_if<list>(&a.value());
+    if (!lst)
+    {
+        throw std::invalid_argument("'x' must be a list");
+    }
+    auto prog = std::get_if<program>(&b.value());
+    if (!prog)
+    {
+        throw std::invalid_argument("'y' must be a program");
+    }
+    return {*lst, *prog};
+}
+
+static mpx list_item(const numeric& v)
+{
+    return std::visit(
+        [](const auto& a) -> mpx {
+            if constexpr (is_one_of_v<decltype(a), mpx>)
+            {
+                return a;
+            }
+            else
+            {
+                throw std::invalid_argument(
+                    "program must return an integer, rational, float, or "
+                    "complex value");
+            }
+        },
+        v);
+}
+
+static bool is_true(const numeric& v)
+{
+    return std::visit(
+        [](const auto& a) -> bool {
+            using a_type = std::decay_t<decltype(a)>;
+            if constexpr (std::is_same_v<a_type, bool>)
+            {
+                return a;
+            }
+            else if constexpr (is_one_of_v<decltype(a), mpx>)
+            {
+                return a != a_type{0};
+            }
+            else
+            {
+                throw std::invalid_argument(
+                    "program must return a boolean or numeric value");
+            }
+        },
+        v);
+}
+
+} // namespace util
+
+struct list_map : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"map"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: {...} $(...) map\n"
+            "\n"
+            "    Returns a list with the result of running the program y\n"
+            "    on each item of list x. The program is run once per item\n"
+            "    with only that item on its stack and must leave a single\n"
+            "    value. Items are processed in parallel; the results are\n"
+            "    in the same order as x.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // two args using num_args
+        auto [lst, prog] = util::list_and_program(calc);
+        std::vector<mpx> items(lst.size());
+        worker_pool::get().parallel_for(
+            lst.size(), [&](size_t begin, size_t end) {
+                auto ctx = calc.fork();
+                Calculator::scoped_context scope(*ctx);
+                for (size_t i = begin; i < end; i++)
+                {
+                    std::vector<numeric> args{variant_cast(lst.values[i])};
+                    items[i] = util::list_item(
+                        util::apply_program(*ctx, prog, std::move(args)));
+                }
+            });
+        calc.stack.pop_front();
+        calc.stack.pop_front();
+        calc.stack.emplace_front(numeric{list{std::move(items)}},
+                                 calc.config.base, calc.config.fixed_bits,
+                                 calc.config.precision, calc.config.is_signed,
+                                 calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 2;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct list_filter : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"filter"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: {...} $(...) filter\n"
+            "\n"
+            "    Returns a list of the items of list x for which the\n"
+            "    program y returns true (or a non-zero value). Items are\n"
+            "    tested in parallel; the order of x is kept.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // two args using num_args
+        auto [lst, prog] = util::list_and_program(calc);
+        std::vector<char> keep(lst.size());
+        worker_pool::get().parallel_for(
+            lst.size(), [&](size_t begin, size_t end) {
+                auto ctx = calc.fork();
+                Calculator::scoped_context scope(*ctx);
+                for (size_t i = begin; i < end; i++)
+                {
+                    std::vector<numeric> args{variant_cast(lst.values[i])};
+                    keep[i] = util::is_true(
+                        util::apply_program(*ctx, prog, std::move(args)));
+                }
+            });
+        std::vector<mpx> items{};
+        for (size_t i = 0; i < lst.size(); i++)
+        {
+            if (keep[i])
+            {
+                items.push_back(lst.values[i]);
+            }
+        }
+        calc.stack.pop_front();
+        calc.stack.pop_front();
+        calc.stack.emplace_front(numeric{list{std::move(items)}},
+                                 calc.config.base, calc.config.fixed_bits,
+                                 calc.config.precision, calc.config.is_signed,
+                                 calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 2;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct list_reduce : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"reduce"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: {...} $(...) reduce\n"
+            "\n"
+            "    Combines the items of list x using the program y, which\n"
+            "    takes two values and leaves one, e.g. {1 2 3} $(+) reduce\n"
+            "    The list is split into runs that are folded in parallel\n"
+            "    and then folded together in order, so y must be\n"
+            "    associative (order is kept, so it need not commute).\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // two args using num_args
+        auto [lst, prog] = util::list_and_program(calc);
+        if (lst.size() == 0)
+        {
+            throw std::invalid_argument("cannot reduce an empty list");
+        }
+        auto fold = [&prog](Calculator& ctx, numeric&& acc,
+                            const numeric& v) {
+            std::vector<numeric> args{std::move(acc), v};
+            return util::apply_program(ctx, prog, std::move(args));
+        };
+        // each run's result is stored at the index where the run starts
+        std::vector<std::optional<numeric>> partial(lst.size());
+        worker_pool::get().parallel_for(
+            lst.size(),
+            [&](size_t begin, size_t end) {
+                auto ctx = calc.fork();
+                Calculator::scoped_context scope(*ctx);
+                numeric acc = variant_cast(lst.values[begin]);
+                for (size_t i = begin + 1; i < end; i++)
+                {
+                    acc = fold(*ctx, std::move(acc),
+                               variant_cast(lst.values[i]));
+                }
+                partial[begin] = std::move(acc);
+            },
+            2);
+        auto ctx = calc.fork();
+        Calculator::scoped_context scope(*ctx);
+        std::optional<numeric> result{};
+        for (auto& p : partial)
+        {
+            if (!p)
+            {
+                continue;
+            }
+            if (!result)
+            {
+                result = std::move(*p);
+            }
+            else
+            {
+                result = fold(*ctx, std::move(*result), *p);
+            }
+        }
+        calc.stack.pop_front();
+        calc.stack.pop_front();
+        calc.stack.emplace_front(std::move(*result), calc.config.base,
+                                 calc.config.fixed_bits, calc.config.precision,
+                                 calc.config.is_signed, calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 2;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+} // namespace function
+} // namespace smrty
+
+register_calc_fn(list_map);
+register_calc_fn(list_filter);
+register_calc_fn(list_reduce);
@@ -107,7 +107,11 @@ struct natural_logarithm : public CalcFunction
                    {
                        if (a > decltype(a){0.0l})
                        {
-                           return {log_fn(mpf{a}), units::unit()};
+                           return {hw_float_op(hw_fn::ln, mpf{a},
+                                               [](const auto& a) {
+                                                   return log_fn(a);
+                                               }),
+                                   units::unit()};
                        }
                        else
                        {
@@ -157,7 +161,7 @@ struct log_base_two : public CalcFunction
             op(calc,
                [](const auto& a,
                   const units::unit&) -> std::tuple<numeric, units::unit> {
-                   mpf log2 = log_fn(mpf{2.0l});
+                   mpf log2 = get_constant(math_constant::ln2);
                    if constexpr (same_type_v<decltype(a), mpc> ||
                                  same_type_v<decltype(a), symbolic>)
                    {
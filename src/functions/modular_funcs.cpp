@@ -5,30 +5,92 @@ SPDX-License-Identifier: BSD-3-Clause
 */
 #include <cmath>
 #include <function.hpp>
+#include <functions/common.hpp>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
 namespace function
 {
 
-mpz pow(const mpz& base, const mpz& exponent, const mpz& modulus)
+namespace util
 {
-    mpz b(base), e(exponent), m(modulus);
-    mpz result{1};
-    while (e > zero)
+
+// x mod m in [0, m)
+static mpz modulo(const mpz& x, const mpz& m)
+{
+    if (m <= zero)
+    {
+        throw std::domain_error("The modulus must be positive");
+    }
+    mpz r = x % m;
+    return r < zero ? mpz{r + m} : r;
+}
+
+static mpz modinv(const mpz& x, const mpz& m)
+{
+    mpz r = invert(modulo(x, m), m);
+    if (r == zero && m != one)
+    {
+        throw std::domain_error("x is not invertible");
+    }
+    return r;
+}
+
+static mpz modexp(const mpz& base, const mpz& exponent, const mpz& m)
+{
+    if (exponent < zero)
     {
-        if (e & one)
+        return powm(modinv(base, m), -exponent, m);
+    }
+    return powm(modulo(base, m), exponent, m);
+}
+
+// the integers in v, which is an integer or a list of integers
+static std::vector<mpz> integers(const numeric& v, std::string_view arg)
+{
+    if (auto z = std::get_if<mpz>(&v); z)
+    {
+        return {*z};
+    }
+    if (auto l = std::get_if<list>(&v); l)
+    {
+        std::vector<mpz> out{};
+        out.reserve(l->size());
+        for (const auto& i : l->values)
+        {
+            auto z = std::get_if<mpz>(&i);
+            if (!z)
+            {
+                break;
+            }
+            out.push_back(*z);
+        }
+        if (out.size() == l->size())
         {
-            result *= b;
-            result %= m;
+            return out;
         }
-        e = e >> 1;
-        b *= b;
-        b %= m;
     }
-    return result;
+    throw std::invalid_argument(
+        std::format("'{}' must be an integer or a list of integers", arg));
+}
+
+// run fn(i) for each of count items on the worker pool and return the
+// results as a list
+static list parallel_list(size_t count, const std::function<mpz(size_t)>& fn)
+{
+    std::vector<mpx> items(count);
+    worker_pool::get().parallel_for(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            items[i] = fn(i);
+        }
+    });
+    return list{std::move(items)};
 }
 
+} // namespace util
+
 struct modexp : public CalcFunction
 {
     virtual const std::string& name() const final
@@ -45,24 +107,48 @@ struct modexp : public CalcFunction
             "\n"
             "    Returns modular exponentiation of the bottom three items on "
             "    the stack, e.g., x raised to the y power mod z (x^y mod z)\n"
+            "\n"
+            "    Either x or y may be a list of integers, which returns a\n"
+            "    list of the results for each item, computed in parallel.\n"
+            "    A negative y raises the inverse of x (mod z) to -y.\n"
             // clang-format on
         };
         return _help;
     }
     virtual bool op(Calculator& calc) const final
     {
-        return three_arg_limited_op(
-            calc,
-            [](const auto& a, const auto& b, const auto& c,
-               const units::unit& ua, const units::unit& ub,
-               const units::unit& uc) -> std::tuple<numeric, units::unit> {
-                if (ua != ub || ua != uc || ua != units::unit())
-                {
-                    throw units_prohibited();
-                }
-                return {pow(a, b, c), ua};
-            },
-            std::tuple<mpz>{});
+        stack_args<3> args(calc);
+        for (size_t i = 0; i < 3; i++)
+        {
+            if (args[i].unit() != units::unit())
+            {
+                throw units_prohibited();
+            }
+        }
+        auto m = std::get_if<mpz>(&args[2].value());
+        if (!m)
+        {
+            throw std::invalid_argument("'z' must be an integer");
+        }
+        bool xs = std::holds_alternative<list>(args[0].value());
+        bool ys = std::holds_alternative<list>(args[1].value());
+        if (xs && ys)
+        {
+            throw std::invalid_argument("Only one of 'x' or 'y' may be a list");
+        }
+        auto x = util::integers(args[0].value(), "x");
+        auto y = util::integers(args[1].value(), "y");
+        if (!xs && !ys)
+        {
+            args.push(util::modexp(x[0], y[0], *m), units::unit());
+            return true;
+        }
+        auto fn = [&](size_t i) {
+            return util::modexp(x[xs ? i : 0], y[ys ? i : 0], *m);
+        };
+        args.push(util::parallel_list(xs ? x.size() : y.size(), fn),
+                  units::unit());
+        return true;
     }
     int num_args() const final
     {
@@ -93,42 +179,110 @@ struct modinv : public CalcFunction
             "    Usage: x y modinv\n"
             "\n"
             "    Returns the multiplicative modular inverse of x (mod y)\n"
+            "\n"
+            "    If x is a list of integers, returns a list of the inverses\n"
+            "    of each item, computed in parallel.\n"
             // clang-format on
         };
         return _help;
     }
     virtual bool op(Calculator& calc) const final
     {
-        return two_arg_limited_op<mpz>(
-            calc,
-            [](const auto& a, const auto& b, const units::unit& ua,
-               const units::unit& ub) -> std::tuple<numeric, units::unit> {
-                if (ua != ub)
-                {
-                    throw units_mismatch();
-                }
-                mpz t(0);
-                mpz newt(1);
-                mpz r = b;
-                mpz newr = a;
-                while (newr != 0)
-                {
-                    mpz quotient = r / newr;
-                    std::tie(t, newt) =
-                        std::make_tuple(newt, t - quotient * newt);
-                    std::tie(r, newr) =
-                        std::make_tuple(newr, r - quotient * newr);
-                }
-                if (r > 1)
-                {
-                    throw std::domain_error("x is not invertible");
-                }
-                if (t < 0)
+        stack_args<2> args(calc);
+        if (args[0].unit() != units::unit() || args[1].unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+        auto m = std::get_if<mpz>(&args[1].value());
+        if (!m)
+        {
+            throw std::invalid_argument("'y' must be an integer");
+        }
+        auto x = util::integers(args[0].value(), "x");
+        if (!std::holds_alternative<list>(args[0].value()))
+        {
+            args.push(util::modinv(x[0], *m), units::unit());
+            return true;
+        }
+        args.push(util::parallel_list(
+                      x.size(),
+                      [&](size_t i) { return util::modinv(x[i], *m); }),
+                  units::unit());
+        return true;
+    }
+    int num_args() const final
+    {
+        return 2;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::paren;
+    }
+};
+
+struct crt : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"crt"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: {r1 r2 ...} {m1 m2 ...} crt\n"
+            "\n"
+            "    Returns the x in [0, m1*m2*...) with x = ri (mod mi) for\n"
+            "    each i using the Chinese remainder theorem. The moduli\n"
+            "    must be pairwise coprime.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        stack_args<2> args(calc);
+        if (args[0].unit() != units::unit() || args[1].unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+        auto r = util::integers(args[0].value(), "x");
+        auto m = util::integers(args[1].value(), "y");
+        if (r.size() != m.size())
+        {
+            throw std::invalid_argument(
+                "'x' and 'y' must be the same length");
+        }
+        mpz n = util::product_tree(std::vector<mpz>(m));
+        // x = sum(ri * Ni * (Ni^-1 mod mi)) mod n, where Ni = n / mi
+        std::vector<mpz> terms(m.size());
+        worker_pool::get().parallel_for(
+            m.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++)
                 {
-                    t += b;
+                    mpz ni = n / m[i];
+                    mpz inv = util::invert(util::modulo(ni, m[i]), m[i]);
+                    if (inv == zero && m[i] != one)
+                    {
+                        throw std::domain_error(
+                            "The moduli must be pairwise coprime");
+                    }
+                    terms[i] = util::modulo(r[i], m[i]) * inv * ni;
                 }
-                return {t, ua};
             });
+        mpz x{0};
+        for (const auto& t : terms)
+        {
+            x = (x + t) % n;
+        }
+        args.push(std::move(x), units::unit());
+        return true;
     }
     int num_args() const final
     {
@@ -140,7 +294,7 @@ struct modinv : public CalcFunction
     }
     symbolic_op symbolic_usage() const final
     {
-        return symbolic_op::paren;
+        return symbolic_op::none;
     }
 };
 
@@ -149,3 +303,4 @@ struct modinv : public CalcFunction
 
 register_calc_fn(modexp);
 register_calc_fn(modinv);
+register_calc_fn(crt);
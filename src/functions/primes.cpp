@@ -0,0 +1,513 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+#include <algorithm>
+#include <cmath>
+#include <function.hpp>
+#include <functions/common.hpp>
+#include <limits>
+#include <mutex>
+#include <worker_pool.hpp>
+
+namespace smrty
+{
+namespace function
+{
+namespace util
+{
+
+namespace
+{
+
+// the primes below this are kept once they have been sieved
+constexpr unsigned long max_cached = 1ul << 26;
+
+// odd numbers per segment; one byte each keeps a segment in the L2 cache
+constexpr unsigned long segment_odds = 1ul << 17;
+
+// the most primes that a single call will put in a list
+constexpr double max_listed = 1e7;
+
+unsigned long isqrt(unsigned long n)
+{
+    auto r = static_cast<unsigned long>(std::sqrt(static_cast<long double>(n)));
+    while (r > 0 && r > n / r)
+    {
+        r--;
+    }
+    while ((r + 1) <= n / (r + 1))
+    {
+        r++;
+    }
+    return r;
+}
+
+// sieve of Eratosthenes over the odd numbers only; index i is 2i+1
+std::vector<unsigned long> simple_sieve(unsigned long n)
+{
+    std::vector<unsigned long> primes{};
+    if (n < 2)
+    {
+        return primes;
+    }
+    primes.push_back(2);
+    std::vector<char> composite((n + 1) / 2);
+    for (unsigned long i = 1; i < composite.size(); i++)
+    {
+        if (composite[i])
+        {
+            continue;
+        }
+        unsigned long p = 2 * i + 1;
+        primes.push_back(p);
+        if (p > n / p)
+        {
+            continue;
+        }
+        for (unsigned long j = p * p / 2; j < composite.size(); j += p)
+        {
+            composite[j] = 1;
+        }
+    }
+    return primes;
+}
+
+// the primes in [lo, hi], given all the primes <= sqrt(hi); the range is
+// split into segments that are sieved in parallel
+std::vector<unsigned long> segmented_sieve(
+    unsigned long lo, unsigned long hi, const std::vector<unsigned long>& base)
+{
+    std::vector<unsigned long> primes{};
+    if (hi < 2 || lo > hi)
+    {
+        return primes;
+    }
+    if (lo <= 2)
+    {
+        primes.push_back(2);
+        lo = 3;
+    }
+    if (lo % 2 == 0)
+    {
+        lo++;
+    }
+    if (lo > hi)
+    {
+        return primes;
+    }
+    unsigned long odds = (hi - lo) / 2 + 1;
+    size_t segments = (odds + segment_odds - 1) / segment_odds;
+    std::vector<std::vector<unsigned long>> found(segments);
+    worker_pool::get().parallel_for(segments, [&](size_t begin, size_t end) {
+        std::vector<char> composite(segment_odds);
+        for (size_t s = begin; s < end; s++)
+        {
+            unsigned long first = lo + 2 * s * segment_odds;
+            unsigned long count =
+                std::min(segment_odds, odds - s * segment_odds);
+            unsigned long last = first + 2 * (count - 1);
+            std::fill_n(composite.begin(), count, 0);
+            for (auto p : base)
+            {
+                if (p == 2)
+                {
+                    continue;
+                }
+                if (p > last / p)
+                {
+                    break;
+                }
+                // the first odd multiple of p in the segment, but never p
+                unsigned long m = std::max(p * p, (first + p - 1) / p * p);
+                if (m % 2 == 0)
+                {
+                    m += p;
+                }
+                for (unsigned long j = (m - first) / 2; j < count; j += p)
+                {
+                    composite[j] = 1;
+                }
+            }
+            for (unsigned long j = 0; j < count; j++)
+            {
+                if (!composite[j])
+                {
+                    found[s].push_back(first + 2 * j);
+                }
+            }
+        }
+    });
+    for (auto& f : found)
+    {
+        primes.insert(primes.end(), f.begin(), f.end());
+    }
+    return primes;
+}
+
+class prime_cache
+{
+  public:
+    static prime_cache& get()
+    {
+        static prime_cache _this{};
+        return _this;
+    }
+
+    // the primes in [lo, hi] for hi <= max_cached
+    std::vector<unsigned long> between(unsigned long lo, unsigned long hi)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (hi > limit)
+        {
+            // grow by at least double so a run of calls with slowly
+            // increasing limits does not sieve a sliver each time
+            unsigned long next = std::min(max_cached, std::max(hi, limit * 2));
+            auto more = segmented_sieve(limit + 1, next,
+                                        simple_sieve(isqrt(next)));
+            lg::debug("prime_cache: sieved {} more primes up to {}\n",
+                      more.size(), next);
+            primes.insert(primes.end(), more.begin(), more.end());
+            limit = next;
+        }
+        return std::vector<unsigned long>(
+            std::lower_bound(primes.begin(), primes.end(), lo),
+            std::upper_bound(primes.begin(), primes.end(), hi));
+    }
+
+  protected:
+    prime_cache() = default;
+
+    std::mutex lock;
+    unsigned long limit = 1;
+    std::vector<unsigned long> primes;
+};
+
+// about how many primes there are in [lo, hi], from pi(x) ~ x / ln(x)
+double prime_count_estimate(unsigned long lo, unsigned long hi)
+{
+    auto pi = [](unsigned long x) {
+        double d = static_cast<double>(x);
+        return x < 3 ? (x < 2 ? 0.0 : 1.0) : d / std::log(d);
+    };
+    return lo > hi ? 0.0 : pi(hi) - pi(lo);
+}
+
+unsigned long to_ulong(const mpz& v)
+{
+    if (v < zero)
+    {
+        return 0;
+    }
+    if (v > mpz{std::numeric_limits<long>::max()})
+    {
+        throw std::range_error("Value is too large");
+    }
+    return static_cast<unsigned long>(v);
+}
+
+} // namespace
+
+std::vector<unsigned long> primes_between(unsigned long lo, unsigned long hi)
+{
+    if (hi <= max_cached)
+    {
+        return prime_cache::get().between(lo, hi);
+    }
+    unsigned long root = isqrt(hi);
+    if (root <= max_cached)
+    {
+        return segmented_sieve(lo, hi, prime_cache::get().between(0, root));
+    }
+    // all the base primes up to sqrt(hi) would be too many to hold, so
+    // sieve with the cached ones only; what is left has no factor below
+    // max_cached and a primality test sorts out the rest
+    auto left =
+        segmented_sieve(lo, hi, prime_cache::get().between(0, max_cached));
+    std::vector<char> keep(left.size());
+    worker_pool::get().parallel_for(
+        left.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                keep[i] = left[i] / max_cached < max_cached ||
+                          is_prime(mpz{left[i]});
+            }
+        },
+        1024);
+    std::vector<unsigned long> primes{};
+    for (size_t i = 0; i < left.size(); i++)
+    {
+        if (keep[i])
+        {
+            primes.push_back(left[i]);
+        }
+    }
+    return primes;
+}
+
+std::vector<unsigned long> primes_up_to(unsigned long n)
+{
+    return primes_between(0, n);
+}
+
+mpz next_prime(const mpz& x)
+{
+    if (x < two)
+    {
+        return two;
+    }
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    mpz n{};
+    mpz_nextprime(n.backend().data(), x.backend().data());
+    return n;
+#else
+    mpz n = x + one;
+    if (n % two == zero)
+    {
+        n += one;
+    }
+    while (!is_prime(n))
+    {
+        n += two;
+    }
+    return n;
+#endif
+}
+
+mpz prev_prime(const mpz& x)
+{
+    if (x <= two)
+    {
+        throw std::domain_error("There are no primes less than 2");
+    }
+    if (x == mpz{3})
+    {
+        return two;
+    }
+    mpz n = x - one;
+    if (n % two == zero)
+    {
+        n -= one;
+    }
+    while (!is_prime(n))
+    {
+        n -= two;
+    }
+    return n;
+}
+
+} // namespace util
+
+struct isprime : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"isprime"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x isprime\n"
+            "\n"
+            "    Returns true if x is prime. The answer is exact for x\n"
+            "    below 2^64; above that, no number that passes is known\n"
+            "    to be composite.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return one_arg_limited_op<mpz>(
+            calc,
+            [](const auto& a,
+               const units::unit& ua) -> std::tuple<numeric, units::unit> {
+                if (ua != units::unit())
+                {
+                    throw units_prohibited();
+                }
+                return {util::is_prime(a), ua};
+            });
+    }
+    int num_args() const final
+    {
+        return 1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct nextprime : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"nextprime"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x nextprime\n"
+            "\n"
+            "    Returns the smallest prime greater than x\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return one_arg_limited_op<mpz>(
+            calc,
+            [](const auto& a,
+               const units::unit& ua) -> std::tuple<numeric, units::unit> {
+                if (ua != units::unit())
+                {
+                    throw units_prohibited();
+                }
+                return {util::next_prime(a), ua};
+            });
+    }
+    int num_args() const final
+    {
+        return 1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct prevprime : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"prevprime"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x prevprime\n"
+            "\n"
+            "    Returns the largest prime less than x\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return one_arg_limited_op<mpz>(
+            calc,
+            [](const auto& a,
+               const units::unit& ua) -> std::tuple<numeric, units::unit> {
+                if (ua != units::unit())
+                {
+                    throw units_prohibited();
+                }
+                return {util::prev_prime(a), ua};
+            });
+    }
+    int num_args() const final
+    {
+        return 1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct primes : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"primes"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x y primes\n"
+            "\n"
+            "    Returns a list of the primes p with x <= p <= y. The\n"
+            "    primes below 2^26 are sieved once and kept for later\n"
+            "    calls; larger ranges are sieved in parallel segments.\n"
+            "    Ranges with more than about 10 million primes are\n"
+            "    rejected.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return two_arg_limited_op<mpz>(
+            calc,
+            [](const auto& a, const auto& b, const units::unit& ua,
+               const units::unit& ub) -> std::tuple<numeric, units::unit> {
+                if (ua != units::unit() || ub != units::unit())
+                {
+                    throw units_prohibited();
+                }
+                unsigned long lo = util::to_ulong(a);
+                unsigned long hi = util::to_ulong(b);
+                if (util::prime_count_estimate(lo, hi) > util::max_listed)
+                {
+                    throw std::range_error(
+                        "Range holds too many primes to list");
+                }
+                auto found = util::primes_between(lo, hi);
+                std::vector<mpx> items{};
+                items.reserve(found.size());
+                for (auto p : found)
+                {
+                    items.emplace_back(mpz{p});
+                }
+                return {list{std::move(items)}, ua};
+            });
+    }
+    int num_args() const final
+    {
+        return 2;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+} // namespace function
+} // namespace smrty
+
+register_calc_fn(isprime);
+register_calc_fn(nextprime);
+register_calc_fn(prevprime);
+register_calc_fn(primes);
@@ -3,13 +3,19 @@ Copyright © 2020 Vernon Mauery; All rights reserved.
 
 SPDX-License-Identifier: BSD-3-Clause
 */
+#include <algorithm>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/seed_seq.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/random/uniform_real_distribution.hpp>
+#include <format>
 #include <function.hpp>
+#include <functional>
 #include <functions/common.hpp>
+#include <limits>
 #include <random>
+#include <tuple>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
@@ -18,14 +24,131 @@ namespace function
 namespace util
 {
 
+namespace
+{
+
+#if !defined(USE_GMP_BACKEND) && !defined(USE_MPFR_BACKEND)
+// when n is more than this many times k, multiplying the k factors of the
+// falling factorial is cheaper than sieving all the primes up to n
+constexpr unsigned long falling_ratio = 64;
+
+// the exponent of p in n! (Legendre's formula)
+unsigned long legendre(unsigned long n, unsigned long p)
+{
+    unsigned long e = 0;
+    while (n >= p)
+    {
+        n /= p;
+        e += n;
+    }
+    return e;
+}
+
+mpz prime_power(unsigned long p, unsigned long e)
+{
+    mpz r{1};
+    mpz b{p};
+    for (; e > 0; e >>= 1)
+    {
+        if (e & 1)
+        {
+            r *= b;
+        }
+        if (e > 1)
+        {
+            b *= b;
+        }
+    }
+    return r;
+}
+
+// n! / (d1! * d2!) for d1 + d2 <= n, from the exponent of each prime in it;
+// the exponents are counted in parallel and the prime powers multiplied in
+// a balanced tree, so no intermediate is larger than the result
+mpz factorial_ratio(unsigned long n, unsigned long d1, unsigned long d2)
+{
+    auto primes = primes_up_to(n);
+    std::vector<mpz> factors(primes.size());
+    worker_pool::get().parallel_for(
+        primes.size(),
+        [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                unsigned long p = primes[i];
+                unsigned long e =
+                    legendre(n, p) - legendre(d1, p) - legendre(d2, p);
+                factors[i] = e ? prime_power(p, e) : one;
+            }
+        },
+        1024);
+    std::erase_if(factors, [](const mpz& f) { return f == one; });
+    return product_tree(std::move(factors));
+}
+
+// n * (n - 1) * ... * (n - k + 1)
+mpz falling_factorial(const mpz& n, unsigned long k)
+{
+    std::vector<mpz> factors{};
+    factors.reserve(k);
+    for (unsigned long i = 0; i < k; i++)
+    {
+        factors.push_back(n - mpz{i});
+    }
+    return product_tree(std::move(factors));
+}
+#endif
+
+unsigned long choice_count(const mpz& x, const mpz& y)
+{
+    if (y < zero || y > x)
+    {
+        throw std::range_error("Undefined unless 0 <= y <= x");
+    }
+    if (y > mpz{std::numeric_limits<long>::max()})
+    {
+        throw std::range_error("y is too large");
+    }
+    return static_cast<unsigned long>(y);
+}
+
+} // namespace
+
 mpz comb(const mpz& x, const mpz& y)
 {
-    return factorial(x) / (factorial(y) * factorial(x - y));
+    // C(x, y) == C(x, x - y); the smaller one has fewer factors
+    unsigned long k = choice_count(x, std::min(y, mpz{x - y}));
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    mpz c{};
+    mpz_bin_ui(c.backend().data(), x.backend().data(), k);
+    return c;
+#else
+    if (x / mpz{falling_ratio} <= mpz{k})
+    {
+        auto n = static_cast<unsigned long>(x);
+        return factorial_ratio(n, k, n - k);
+    }
+    return falling_factorial(x, k) / factorial(mpz{k});
+#endif
 }
 
 mpz perm(const mpz& x, const mpz& y)
 {
-    return factorial(x) / factorial(x - y);
+    unsigned long k = choice_count(x, y);
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    // x! / (x - y)! == C(x, y) * y!
+    mpz c{};
+    mpz_bin_ui(c.backend().data(), x.backend().data(), k);
+    mpz f{};
+    mpz_fac_ui(f.backend().data(), k);
+    return c * f;
+#else
+    if (x / mpz{falling_ratio} <= mpz{k})
+    {
+        auto n = static_cast<unsigned long>(x);
+        return factorial_ratio(n, n - k, 0);
+    }
+    return falling_factorial(x, k);
+#endif
 }
 
 // private namespace for generator used by random functions
@@ -82,6 +205,269 @@ mpq rand(unsigned long bits)
     return mpq(rand_dist(zero, high), high);
 }
 
+namespace
+{
+
+// samples longer than this are accumulated in chunks of this many values
+// on the worker pool
+constexpr size_t moments_chunk = 4096;
+
+mpf sample_value(const auto& v)
+{
+    if (auto zp = std::get_if<mpz>(&v); zp)
+    {
+        return static_cast<mpf>(*zp);
+    }
+    if (auto qp = std::get_if<mpq>(&v); qp)
+    {
+        return static_cast<mpf>(*qp);
+    }
+    if (auto fp = std::get_if<mpf>(&v); fp)
+    {
+        return *fp;
+    }
+    throw std::invalid_argument("items must all be integer, rational, or real");
+}
+
+mpf as_mpf(size_t n)
+{
+    return static_cast<mpf>(mpz{n});
+}
+
+// the mean and central moments of a sample, updated one value at a time
+// (Welford); the moments of two parts of a sample merge into those of the
+// whole (Chan et al.), so the parts can be accumulated independently
+class moments
+{
+  public:
+    void add(const mpf& x)
+    {
+        mpf n1 = as_mpf(items);
+        items++;
+        mpf n = as_mpf(items);
+        mpf delta = x - mu;
+        mpf dn = delta / n;
+        mpf dn2 = dn * dn;
+        mpf term = delta * dn * n1;
+        mu += dn;
+        m4 += term * dn2 * (n * n - mpf{3} * n + mpf{3}) +
+              mpf{6} * dn2 * m2 - mpf{4} * dn * m3;
+        m3 += term * dn * (n - mpf{2}) - mpf{3} * dn * m2;
+        m2 += term;
+    }
+    void merge(const moments& o)
+    {
+        if (o.items == 0)
+        {
+            return;
+        }
+        if (items == 0)
+        {
+            *this = o;
+            return;
+        }
+        mpf na = as_mpf(items);
+        mpf nb = as_mpf(o.items);
+        mpf n = na + nb;
+        mpf d = o.mu - mu;
+        mpf d2 = d * d;
+        mpf m4n = m4 + o.m4 +
+                  d2 * d2 * na * nb * (na * na - na * nb + nb * nb) /
+                      (n * n * n) +
+                  mpf{6} * d2 * (na * na * o.m2 + nb * nb * m2) / (n * n) +
+                  mpf{4} * d * (na * o.m3 - nb * m3) / n;
+        mpf m3n = m3 + o.m3 + d2 * d * na * nb * (na - nb) / (n * n) +
+                  mpf{3} * d * (na * o.m2 - nb * m2) / n;
+        m2 += o.m2 + d2 * na * nb / n;
+        m3 = std::move(m3n);
+        m4 = std::move(m4n);
+        mu += d * nb / n;
+        items += o.items;
+    }
+
+    size_t size() const
+    {
+        return items;
+    }
+    const mpf& mean() const
+    {
+        return mu;
+    }
+    // sample variance, with Bessel's correction
+    mpf variance() const
+    {
+        if (items < 2)
+        {
+            throw std::invalid_argument("requires at least two items");
+        }
+        return m2 / as_mpf(items - 1);
+    }
+    // population skewness, m3 / m2^(3/2)
+    mpf skew() const
+    {
+        spread();
+        return sqrt_fn(as_mpf(items)) * m3 / (m2 * sqrt_fn(m2));
+    }
+    // population excess kurtosis, m4 / m2^2 - 3
+    mpf kurtosis() const
+    {
+        spread();
+        return as_mpf(items) * m4 / (m2 * m2) - mpf{3};
+    }
+
+  protected:
+    void spread() const
+    {
+        if (m2 == mpf{0})
+        {
+            throw std::domain_error("Undefined for items that are all equal");
+        }
+    }
+
+    size_t items = 0;
+    mpf mu{0};
+    // sums of the 2nd, 3rd and 4th powers of the deviations from the mean
+    mpf m2{0};
+    mpf m3{0};
+    mpf m4{0};
+};
+
+// the moments of count values, where value(i) is the i-th; long samples
+// are cut into chunks that are accumulated in parallel and merged in order
+moments sample_moments(size_t count,
+                       const std::function<mpf(size_t)>& value)
+{
+    size_t chunks = (count + moments_chunk - 1) / moments_chunk;
+    std::vector<moments> parts(chunks);
+    worker_pool::get().parallel_for(chunks, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+        {
+            size_t last = std::min(count, (c + 1) * moments_chunk);
+            for (size_t i = c * moments_chunk; i < last; i++)
+            {
+                parts[c].add(value(i));
+            }
+        }
+    });
+    moments m{};
+    for (const auto& p : parts)
+    {
+        m.merge(p);
+    }
+    return m;
+}
+
+// whether the sample on the stack (as for sample_stat) is all real, with
+// at least one float, and in a single unit; only such data goes through
+// the moments accumulator for mean and gmean, which keep exact sums and
+// products for exact or complex data
+bool float_sample(Calculator& calc, bool positive)
+{
+    bool floats = false;
+    auto real = [&floats, positive](const auto& v) {
+        if (std::holds_alternative<mpf>(v))
+        {
+            floats = true;
+        }
+        else if (!std::holds_alternative<mpz>(v) &&
+                 !std::holds_alternative<mpq>(v))
+        {
+            return false;
+        }
+        return !positive || sample_value(v) > mpf{0};
+    };
+    stack_entry& e = calc.stack.front();
+    if (auto lp = std::get_if<list>(&e.value()); lp)
+    {
+        return std::ranges::all_of(lp->values, real) && floats;
+    }
+    auto v = std::get_if<mpz>(&e.value());
+    if (!v || *v <= zero || *v >= static_cast<mpz>(calc.stack.size()))
+    {
+        return false;
+    }
+    size_t count = static_cast<size_t>(*v);
+    const units::unit& u = calc.stack[1].unit();
+    for (size_t i = 1; i <= count; i++)
+    {
+        const stack_entry& s = calc.stack[i];
+        if (s.unit() != u || !real(s.value()))
+        {
+            return false;
+        }
+    }
+    return floats;
+}
+
+using sample_fn = std::function<std::tuple<mpf, units::unit>(
+    const moments&, const units::unit&)>;
+
+// replace the sample on the stack, either n and the n items below it or a
+// single list, with a statistic of it; fn gets the moments of the sample
+// (of transform(x) for each x, if given) and the units of its items
+bool sample_stat(Calculator& calc, std::string_view name, const sample_fn& fn,
+                 const std::function<mpf(const mpf&)>& transform = {})
+{
+    // required entry provided by num_args
+    stack_entry& e = calc.stack.front();
+    if (e.unit() != units::unit())
+    {
+        throw units_prohibited();
+    }
+    auto value_of = [&transform](const auto& v) {
+        return transform ? transform(sample_value(v)) : sample_value(v);
+    };
+    moments m{};
+    units::unit u{};
+    size_t consumed = 1;
+    if (auto lp = std::get_if<list>(&e.value()); lp)
+    {
+        const auto& values = lp->values;
+        m = sample_moments(values.size(),
+                           [&](size_t i) { return value_of(values[i]); });
+    }
+    else if (auto v = std::get_if<mpz>(&e.value());
+             v && *v > zero && *v < static_cast<mpz>(calc.stack.size()))
+    {
+        size_t count = static_cast<size_t>(*v);
+        u = calc.stack[1].unit();
+        // resolve all the values here so the workers only read them
+        std::vector<const numeric*> items(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const stack_entry& s = calc.stack[count - i];
+            if (s.unit() != u)
+            {
+                throw units_mismatch();
+            }
+            items[i] = &s.value();
+        }
+        m = sample_moments(count,
+                           [&](size_t i) { return value_of(*items[i]); });
+        consumed += count;
+    }
+    else
+    {
+        throw std::invalid_argument(
+            std::format("Invalid arguments for {}", name));
+    }
+    if (m.size() == 0)
+    {
+        throw std::invalid_argument("requires at least one item");
+    }
+    auto [r, ru] = fn(m, u);
+    for (; consumed > 0; consumed--)
+    {
+        calc.stack.pop_front();
+    }
+    calc.stack.emplace_front(numeric{std::move(r)}, ru, calc.config.base,
+                             calc.config.fixed_bits, calc.config.precision,
+                             calc.config.is_signed, calc.flags);
+    return true;
+}
+
+} // namespace
+
 } // namespace util
 
 struct combination : public CalcFunction
@@ -131,7 +517,7 @@ struct combination : public CalcFunction
         const mpz* y = std::get_if<mpz>(&e0.value());
         if (!x || !y || (*y > *x))
         {
-            throw std::invalid_argument("requires integers such that x < y");
+            throw std::invalid_argument("requires integers such that y <= x");
         }
         calc.stack.pop_front();
         calc.stack.pop_front();
@@ -196,7 +582,7 @@ struct permutation : public CalcFunction
         const mpz* y = std::get_if<mpz>(&e0.value());
         if (!x || !y || (*y > *x))
         {
-            throw std::invalid_argument("requires integers such that x < y");
+            throw std::invalid_argument("requires integers such that y <= x");
         }
         calc.stack.pop_front();
         calc.stack.pop_front();
@@ -237,31 +623,28 @@ struct mean : public CalcFunction
             "\n"
             "    Returns the mean of the bottom n items on the stack\n"
             "    or the bottom single item that is a list\n"
+            "\n"
+            "    Exact and complex items are summed exactly. Real samples\n"
+            "    with floats are read in a single pass, like the other\n"
+            "    sample statistics, with long samples accumulated in\n"
+            "    parallel chunks whose partial results are then merged\n"
             // clang-format on
         };
         return _help;
     }
-    bool mean_from_stack(Calculator& calc, const mpz& v) const
+    bool mean_from_stack(Calculator& calc, size_t count) const
     {
-        size_t count = static_cast<size_t>(v) - 1;
         auto n = calc.stack.front();
         calc.stack.pop_front();
-        for (; count > 0; count--)
-        {
-            // no need to check the return;
-            // it is either true or it throws an exception
-            util::add_from_stack(calc);
-        }
+        // no need to check the return;
+        // it is either true or it throws an exception
+        util::add_n_from_stack(calc, count);
         calc.stack.push_front(n);
         return util::divide_from_stack(calc);
     }
     bool mean_from_list(Calculator& calc, const list& lst) const
     {
-        list::element_type sum{mpz{0}};
-        for (const auto& v : lst.values)
-        {
-            sum = sum + v;
-        }
+        auto sum = util::sum_tree(std::vector<mpx>(lst.values));
         auto mean = sum / list::element_type{mpz{lst.size()}};
         calc.stack.pop_front();
         std::visit(
@@ -281,16 +664,25 @@ struct mean : public CalcFunction
         {
             throw units_prohibited();
         }
+        if (util::float_sample(calc, false))
+        {
+            return util::sample_stat(
+                calc, name(),
+                [](const util::moments& m,
+                   const units::unit& u) -> std::tuple<mpf, units::unit> {
+                    return {m.mean(), u};
+                });
+        }
         const mpz* v = std::get_if<mpz>(&e.value());
-        if (v && (*v < static_cast<mpz>(calc.stack.size())))
+        if (v && *v > zero && *v < static_cast<mpz>(calc.stack.size()))
         {
-            return mean_from_stack(calc, *v);
+            return mean_from_stack(calc, static_cast<size_t>(*v));
         }
         if (auto lp = std::get_if<list>(&e.value()); lp)
         {
             return mean_from_list(calc, *lp);
         }
-        throw std::invalid_argument("Invalid aruments for mean");
+        throw std::invalid_argument("Invalid arguments for mean");
     }
     int num_args() const final
     {
@@ -322,39 +714,30 @@ struct geometric_mean : public CalcFunction
             "           { x1 x2... xn } gmean\n"
             "\n"
             "    Returns the geometric mean of the bottom n items on the stack\n"
-            "    or the bottom single item that is a list\n"
+            "    or the bottom single item that is a list. Positive real\n"
+            "    samples with floats are computed as exp(mean(ln x))\n"
             // clang-format on
         };
         return _help;
     }
-    bool gmean_from_stack(Calculator& calc, const mpz& v) const
+    bool gmean_from_stack(Calculator& calc, size_t count) const
     {
-        size_t count = static_cast<size_t>(v) - 1;
         auto n = calc.stack.front();
         calc.stack.pop_front();
-        for (; count > 0; count--)
-        {
-            // no need to check the return;
-            // it is either true or it throws an exception
-            util::multiply_from_stack(calc);
-        }
+        // no need to check the return;
+        // it is either true or it throws an exception
+        util::multiply_n_from_stack(calc, count);
         calc.stack.push_front(n);
         util::inverse_from_stack(calc);
         return util::power_from_stack(calc);
     }
     bool gmean_from_list(Calculator& calc, const list& lst) const
     {
-        list::element_type prod{mpz{1}};
-        for (const auto& v : lst.values)
-        {
-            lg::debug("{} * {} = {}\n", prod, v, prod * v);
-            prod = prod * v;
-        }
+        auto prod = util::product_tree(std::vector<mpx>(lst.values));
         mpq p{1, lst.size()};
         calc.stack.pop_front();
         std::visit(
             [&](const auto& v) {
-                lg::debug("{} ^ {} = {}\n", v, p, util::power_direct(v, p));
                 calc.stack.emplace_front(
                     util::power_direct(v, p), calc.config.base,
                     calc.config.fixed_bits, calc.config.precision,
@@ -371,16 +754,30 @@ struct geometric_mean : public CalcFunction
         {
             throw units_prohibited();
         }
+        if (util::float_sample(calc, true))
+        {
+            return util::sample_stat(
+                calc, name(),
+                [](const util::moments& m,
+                   const units::unit& u) -> std::tuple<mpf, units::unit> {
+                    if (u != units::unit())
+                    {
+                        throw units_prohibited();
+                    }
+                    return {exp_fn(m.mean()), u};
+                },
+                [](const mpf& x) { return log_fn(x); });
+        }
         const mpz* v = std::get_if<mpz>(&e.value());
-        if (v && (*v < static_cast<mpz>(calc.stack.size())))
+        if (v && *v > zero && *v < static_cast<mpz>(calc.stack.size()))
         {
-            return gmean_from_stack(calc, *v);
+            return gmean_from_stack(calc, static_cast<size_t>(*v));
         }
         if (auto lp = std::get_if<list>(&e.value()); lp)
         {
             return gmean_from_list(calc, *lp);
         }
-        throw std::invalid_argument("Invalid aruments for gmean");
+        throw std::invalid_argument("Invalid arguments for gmean");
     }
     int num_args() const final
     {
@@ -539,6 +936,54 @@ struct median : public CalcFunction
     }
 };
 
+struct variance : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"var"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x1 x2... xn n var\n"
+            "           { x1 x2... xn } var\n"
+            "\n"
+            "    Returns the sample variance of the bottom n items on the\n"
+            "    stack or the bottom single item that is a list\n"
+            "\n"
+            "            1      n\n"
+            "    var = ----- * sum (xi - mean)^2\n"
+            "          n - 1   i=1\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return util::sample_stat(
+            calc, name(),
+            [](const util::moments& m,
+               const units::unit& u) -> std::tuple<mpf, units::unit> {
+                return {m.variance(), u * u};
+            });
+    }
+    int num_args() const final
+    {
+        return -1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
 struct stddev : public CalcFunction
 {
     virtual const std::string& name() const final
@@ -554,8 +999,145 @@ struct stddev : public CalcFunction
             "    Usage: x1 x2... xn n stddev\n"
             "           { x1 x2... xn } stddev\n"
             "\n"
-            "    Returns the standard deviation of the bottom n items on the stack\n"
-            "    or the bottom single item that is a list\n"
+            "    Returns the sample standard deviation, sqrt(var), of the\n"
+            "    bottom n items on the stack or the bottom single item that\n"
+            "    is a list\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return util::sample_stat(
+            calc, name(),
+            [](const util::moments& m,
+               const units::unit& u) -> std::tuple<mpf, units::unit> {
+                return {sqrt_fn(m.variance()), u};
+            });
+    }
+    int num_args() const final
+    {
+        return -1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct skewness : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"skew"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x1 x2... xn n skew\n"
+            "           { x1 x2... xn } skew\n"
+            "\n"
+            "    Returns the skewness, m3 / m2^(3/2), of the bottom n items\n"
+            "    on the stack or the bottom single item that is a list, where\n"
+            "    mk is the kth central moment of the items\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return util::sample_stat(
+            calc, name(),
+            [](const util::moments& m,
+               const units::unit& u) -> std::tuple<mpf, units::unit> {
+                return {m.skew(), units::unit()};
+            });
+    }
+    int num_args() const final
+    {
+        return -1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct kurtosis : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"kurtosis"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x1 x2... xn n kurtosis\n"
+            "           { x1 x2... xn } kurtosis\n"
+            "\n"
+            "    Returns the excess kurtosis, m4 / m2^2 - 3, of the bottom n\n"
+            "    items on the stack or the bottom single item that is a list,\n"
+            "    where mk is the kth central moment of the items\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        return util::sample_stat(
+            calc, name(),
+            [](const util::moments& m,
+               const units::unit& u) -> std::tuple<mpf, units::unit> {
+                return {m.kurtosis(), units::unit()};
+            });
+    }
+    int num_args() const final
+    {
+        return -1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct quantile : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"quantile"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x1 x2... xn n p quantile\n"
+            "           { x1 x2... xn } p quantile\n"
+            "\n"
+            "    Returns the p quantile (0 <= p <= 1) of the bottom n items\n"
+            "    on the stack or the single item that is a list, linearly\n"
+            "    interpolated between the nearest two items; the 0.5\n"
+            "    quantile is the median\n"
             // clang-format on
         };
         return _help;
@@ -563,40 +1145,74 @@ struct stddev : public CalcFunction
     virtual bool op(Calculator& calc) const final
     {
         // first two args provided by num_args
-        stack_entry e = calc.stack.front();
-        if (e.unit() != units::unit())
+        stack_entry& pe = calc.stack[0];
+        stack_entry& e = calc.stack[1];
+        if (pe.unit() != units::unit() || e.unit() != units::unit())
         {
             throw units_prohibited();
         }
-        const mpz* v = std::get_if<mpz>(&e.value());
-        if (!v || (*v > 1000000000) || (*v <= mpz{0}) ||
-            (*v >= static_cast<mpz>(calc.stack.size())))
+        mpf p = util::sample_value(pe.value());
+        if (p < mpf{0} || p > mpf{1})
         {
-            throw std::invalid_argument(
-                "n must be an integer greater than 0 and less the stack depth");
+            throw std::domain_error("p must be between 0 and 1");
         }
-        size_t count = static_cast<size_t>(*v);
-        if (calc.stack.size() < (count + 1))
+        std::vector<mpf> items{};
+        units::unit u{};
+        size_t consumed = 2;
+        if (auto lp = std::get_if<list>(&e.value()); lp)
+        {
+            items.reserve(lp->size());
+            for (const auto& v : lp->values)
+            {
+                items.push_back(util::sample_value(v));
+            }
+        }
+        else if (auto v = std::get_if<mpz>(&e.value());
+                 v && *v > zero &&
+                 *v < static_cast<mpz>(calc.stack.size() - 1))
         {
-            throw insufficient_args();
+            size_t count = static_cast<size_t>(*v);
+            u = calc.stack[2].unit();
+            items.reserve(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                const stack_entry& s = calc.stack[count + 1 - i];
+                if (s.unit() != u)
+                {
+                    throw units_mismatch();
+                }
+                items.push_back(util::sample_value(s.value()));
+            }
+            consumed += count;
         }
-        // the first on-stack function built up from rpn primitives?
-
-        /*
-        "$(depth 'n' sto 'n' eval 2list dup split mean 'mu' sto split 0 swap "
-        "for i in range do 'mu' eval - sqr 'n' eval rolldn done 'n' eval mean "
-        "sqrt)"
-        */
-        calc.stack.pop_front();
-        // only go from count to 1 because each op takes two items
-        for (; count > 1; count--)
+        else
         {
-            // add from stack always returns true or throws
-            util::add_from_stack(calc);
+            throw std::invalid_argument("Invalid arguments for quantile");
         }
-        calc.stack.push_front(e);
-
-        return util::divide_from_stack(calc);
+        if (items.empty())
+        {
+            throw std::invalid_argument("requires at least one item");
+        }
+        // only the items on either side of h need to be in place
+        mpf h = p * util::as_mpf(items.size() - 1);
+        auto lo = static_cast<size_t>(static_cast<double>(floor_fn(h)));
+        lo = std::min(lo, items.size() - 1);
+        std::nth_element(items.begin(), items.begin() + lo, items.end());
+        mpf q = items[lo];
+        mpf frac = h - util::as_mpf(lo);
+        if (lo + 1 < items.size() && frac != mpf{0})
+        {
+            mpf next = *std::min_element(items.begin() + lo + 1, items.end());
+            q += frac * (next - q);
+        }
+        for (; consumed > 0; consumed--)
+        {
+            calc.stack.pop_front();
+        }
+        calc.stack.emplace_front(numeric{std::move(q)}, u, calc.config.base,
+                                 calc.config.fixed_bits, calc.config.precision,
+                                 calc.config.is_signed, calc.flags);
+        return true;
     }
     int num_args() const final
     {
@@ -726,6 +1342,10 @@ register_calc_fn(permutation);
 register_calc_fn(mean);
 register_calc_fn(geometric_mean);
 register_calc_fn(median);
+register_calc_fn(variance);
 register_calc_fn(stddev);
+register_calc_fn(skewness);
+register_calc_fn(kurtosis);
+register_calc_fn(quantile);
 register_calc_fn(rand);
 register_calc_fn(rand_dist);
@@ -34,21 +34,13 @@ struct product : public CalcFunction
     }
     bool product_from_stack(Calculator& calc, const mpz& v) const
     {
-        size_t count = static_cast<size_t>(v) - 1;
+        size_t count = static_cast<size_t>(v);
         calc.stack.pop_front();
-        for (; count > 0; count--)
-        {
-            util::multiply_from_stack(calc);
-        }
-        return true;
+        return util::multiply_n_from_stack(calc, count);
     }
     bool product_from_list(Calculator& calc, const list& lst) const
     {
-        list::element_type sum{mpz{1}};
-        for (const auto& v : lst.values)
-        {
-            sum = sum * v;
-        }
+        auto sum = util::product_tree(std::vector<mpx>(lst.values));
         calc.stack.pop_front();
         std::visit(
             [&](auto&& v) {
@@ -68,7 +60,7 @@ struct product : public CalcFunction
             throw units_prohibited();
         }
         const mpz* v = std::get_if<mpz>(&e.value());
-        if (v && (*v < static_cast<mpz>(calc.stack.size())))
+        if (v && *v > zero && *v < static_cast<mpz>(calc.stack.size()))
         {
             return product_from_stack(calc, *v);
         }
@@ -4,12 +4,70 @@ Copyright © 2024 Vernon Mauery; All rights reserved.
 SPDX-License-Identifier: BSD-3-Clause
 */
 #include <function.hpp>
+#include <functions/common.hpp>
+#include <optimizer.hpp>
+#include <optional>
+#include <ui.hpp>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
 namespace function
 {
 
+namespace util
+{
+
+void run_program(Calculator& calc, const program& prog)
+{
+    program p{prog};
+    calc.var_scope_enter();
+    try
+    {
+        p.execute(
+            [&calc](const simple_instruction& itm, execution_flags& eflags) {
+                bool retval = calc.run_one(itm);
+                eflags = calc.flags;
+                return retval;
+            },
+            calc.flags);
+    }
+    catch (...)
+    {
+        calc.var_scope_exit();
+        throw;
+    }
+    calc.var_scope_exit();
+}
+
+numeric apply_program(Calculator& calc, const program& prog,
+                      std::vector<numeric>&& args)
+{
+    calc.stack.clear();
+    for (auto& a : args)
+    {
+        calc.stack.emplace_front(std::move(a), calc.config.base,
+                                 calc.config.fixed_bits, calc.config.precision,
+                                 calc.config.is_signed, calc.flags);
+    }
+    run_program(calc, prog);
+    if (calc.stack.size() != 1)
+    {
+        throw std::invalid_argument(
+            std::format("program must leave exactly one value; it left {}",
+                        calc.stack.size()));
+    }
+    if (calc.stack.front().unit() != units::unit())
+    {
+        throw units_prohibited();
+    }
+    numeric result = calc.stack.front().value();
+    calc.stack.clear();
+    return result;
+}
+
+} // namespace util
+
 struct execute : public CalcFunction
 {
     virtual const std::string& name() const final
@@ -70,7 +128,274 @@ struct execute : public CalcFunction
     }
 };
 
+struct background : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"bg"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: x1 ... xn $(...) n bg\n"
+            "\n"
+            "    Runs the program in the background with x1 ... xn as its\n"
+            "    stack and replaces them with a single <pending> entry.\n"
+            "    The entry is filled in with the value the program leaves\n"
+            "    once it finishes. Anything that uses the entry before\n"
+            "    then waits for it; if the program failed, using the\n"
+            "    entry reports the error.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // two args using num_args
+        stack_entry& ne = calc.stack[0];
+        stack_entry& pe = calc.stack[1];
+        if (ne.unit() != units::unit() || pe.unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+        auto pn = std::get_if<mpz>(&ne.value());
+        if (!pn || *pn < zero)
+        {
+            throw std::invalid_argument("'n' must be a non-negative integer");
+        }
+        auto prog = std::get_if<program>(&pe.value());
+        if (!prog)
+        {
+            throw std::invalid_argument("argument is not a program");
+        }
+        size_t count = static_cast<size_t>(*pn);
+        if (calc.stack.size() < (count + 2))
+        {
+            throw insufficient_args();
+        }
+        // copies of the entries let pending arguments resolve in the
+        // background instead of here
+        std::vector<stack_entry> entries{};
+        entries.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            entries.push_back(calc.stack[count + 1 - i]);
+        }
+        std::string desc = std::format("{}", *prog);
+        auto job = worker_pool::get().submit(
+            [ctx{calc.fork()}, prog{program{*prog}},
+             entries{std::move(entries)}]() mutable
+            -> stack_entry::pending_result {
+                Calculator::scoped_context scope(*ctx);
+                std::vector<numeric> args{};
+                args.reserve(entries.size());
+                for (const auto& e : entries)
+                {
+                    if (e.unit() != units::unit())
+                    {
+                        throw units_prohibited();
+                    }
+                    args.push_back(e.value());
+                }
+                return {util::apply_program(*ctx, prog, std::move(args)),
+                        units::unit()};
+            });
+        for (size_t i = 0; i < (count + 2); i++)
+        {
+            calc.stack.pop_front();
+        }
+        calc.stack.emplace_front(job.share(), desc, calc.config.base,
+                                 calc.config.fixed_bits, calc.config.precision,
+                                 calc.config.is_signed);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 2;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct fork_join : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"forkjoin"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: $(...) ... $(...) n forkjoin\n"
+            "\n"
+            "    Runs the n programs at the same time, each on its own\n"
+            "    copy of the stack below the programs. The stack is left\n"
+            "    as it was and the top item each program leaves is pushed\n"
+            "    in the order the programs were given.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // only n is guaranteed by num_args; the programs are checked below
+        stack_entry& ne = calc.stack[0];
+        if (ne.unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+        auto pn = std::get_if<mpz>(&ne.value());
+        if (!pn || *pn <= zero)
+        {
+            throw std::invalid_argument("'n' must be a positive integer");
+        }
+        size_t count = static_cast<size_t>(*pn);
+        if (calc.stack.size() < (count + 1))
+        {
+            throw insufficient_args();
+        }
+        std::vector<program> progs{};
+        progs.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            auto prog = std::get_if<program>(&calc.stack[count - i].value());
+            if (!prog)
+            {
+                throw std::invalid_argument(
+                    std::format("item {} is not a program", i + 1));
+            }
+            progs.push_back(*prog);
+        }
+        Calculator::Stack snapshot(calc.stack.begin() + count + 1,
+                                   calc.stack.end());
+
+        std::vector<std::optional<stack_entry>> results(count);
+        worker_pool::get().parallel_for(count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                auto ctx = calc.fork();
+                Calculator::scoped_context scope(*ctx);
+                ctx->stack = snapshot;
+                util::run_program(*ctx, progs[i]);
+                if (ctx->stack.size() == 0)
+                {
+                    throw std::invalid_argument(std::format(
+                        "program {} left an empty stack", i + 1));
+                }
+                results[i] = std::move(ctx->stack.front());
+            }
+        });
+        for (size_t i = 0; i < (count + 1); i++)
+        {
+            calc.stack.pop_front();
+        }
+        for (auto& r : results)
+        {
+            calc.stack.push_front(std::move(*r));
+        }
+        return true;
+    }
+    int num_args() const final
+    {
+        return -1;
+    }
+    int num_resp() const final
+    {
+        return -1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
+struct optimize : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"optimize"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: $(...) optimize\n"
+            "\n"
+            "    Replaces the program with an optimized copy and lists\n"
+            "    the changes made. Exact literals feeding pure functions\n"
+            "    are folded (2 3 * 10 + becomes 16) and common pairs\n"
+            "    such as 'dup *', 'swap -' and '1 +' become one step.\n"
+            "    User-defined functions are optimized this way when they\n"
+            "    are defined; folding is skipped while fixed_bits is set.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // one arg using num_args
+        stack_entry& e = calc.stack.front();
+        if (e.unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+        auto p = std::get_if<program>(&e.value());
+        if (!p)
+        {
+            throw std::invalid_argument("argument is not a program");
+        }
+        optimizer_report report{};
+        // folded constants would lose the carry and overflow flags that
+        // the fixed width operations set
+        program opt =
+            optimize_program(*p, report, calc.config.fixed_bits == 0);
+        auto ui = ui::get();
+        if (report.size() == 0)
+        {
+            ui->out("no changes\n");
+        }
+        for (const auto& line : report)
+        {
+            ui->out("{}\n", line);
+        }
+        calc.stack.pop_front();
+        calc.stack.emplace_front(std::move(opt), calc.config.base,
+                                 calc.config.fixed_bits, calc.config.precision,
+                                 calc.config.is_signed, calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 1;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
 } // namespace function
 } // namespace smrty
 
 register_calc_fn(execute);
+register_calc_fn(background);
+register_calc_fn(fork_join);
+register_calc_fn(optimize);
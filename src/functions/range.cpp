@@ -33,16 +33,13 @@ struct range : public CalcFunction
     virtual bool op(Calculator& calc) const final
     {
         // two args using num_args
-        stack_entry xe = calc.stack[0];
-        stack_entry ye = calc.stack[1];
-        const mpz* x = std::get_if<mpz>(&xe.value());
-        const mpz* y = std::get_if<mpz>(&ye.value());
+        stack_args<2> args(calc);
+        const mpz* x = std::get_if<mpz>(&args[1].value());
+        const mpz* y = std::get_if<mpz>(&args[0].value());
         if (!x || !y)
         {
             throw std::runtime_error("range requires two integers");
         }
-        calc.stack.pop_front();
-        calc.stack.pop_front();
         mpz step, count;
         if (*x > *y)
         {
@@ -61,6 +58,7 @@ struct range : public CalcFunction
             items.push_back(v);
             v += step;
         }
+        args.commit();
         calc.stack.emplace_front(numeric{list{std::move(items)}},
                                  calc.config.base, calc.config.fixed_bits,
                                  calc.config.precision, calc.config.is_signed,
@@ -47,7 +47,11 @@ struct square_root : public CalcFunction
                    {
                        if (a >= decltype(a){0.0l})
                        {
-                           return {sqrt_fn(mpf{a}), units::pow(ua, mpf{0.5l})};
+                           return {hw_float_op(hw_fn::sqrt, mpf{a},
+                                               [](const auto& a) {
+                                                   return sqrt_fn(a);
+                                               }),
+                                   units::pow(ua, mpf{0.5l})};
                        }
                        else
                        {
@@ -36,23 +36,13 @@ struct sum : public CalcFunction
     }
     bool sum_from_stack(Calculator& calc, const mpz& v) const
     {
-        size_t count = static_cast<size_t>(v) - 1;
+        size_t count = static_cast<size_t>(v);
         calc.stack.pop_front();
-        for (; count > 0; count--)
-        {
-            // no need to check the return;
-            // it is either true or it throws an exception
-            util::add_from_stack(calc);
-        }
-        return true;
+        return util::add_n_from_stack(calc, count);
     }
     bool sum_from_list(Calculator& calc, const list& lst) const
     {
-        list::element_type sum{mpz{0}};
-        for (const auto& v : lst.values)
-        {
-            sum = sum + v;
-        }
+        auto sum = util::sum_tree(std::vector<mpx>(lst.values));
         calc.stack.pop_front();
         std::visit(
             [&](auto&& v) {
@@ -72,7 +62,7 @@ struct sum : public CalcFunction
             throw units_prohibited();
         }
         const mpz* v = std::get_if<mpz>(&e.value());
-        if (v && (*v < static_cast<mpz>(calc.stack.size())))
+        if (v && *v > zero && *v < static_cast<mpz>(calc.stack.size()))
         {
             return sum_from_stack(calc, *v);
         }
@@ -4,6 +4,9 @@ Copyright © 2024 Vernon Mauery; All rights reserved.
 SPDX-License-Identifier: BSD-3-Clause
 */
 #include <function.hpp>
+#include <limits>
+#include <optional>
+#include <worker_pool.hpp>
 
 namespace smrty
 {
@@ -37,11 +40,12 @@ struct Eval : public CalcFunction
         }
         stack_entry& a = calc.stack.front();
 
-        if (auto s = std::get_if<symbolic>(&a.value()); s)
+        if (std::holds_alternative<symbolic>(a.value()))
         {
-            auto v = *s;
+            // move it off so its compiled form is kept
+            numeric v = a.take_value();
             calc.stack.pop_front();
-            v.eval(calc);
+            std::get<symbolic>(v).eval(calc);
         }
         return true;
     }
@@ -59,7 +63,152 @@ struct Eval : public CalcFunction
     }
 };
 
+struct tabulate : public CalcFunction
+{
+    virtual const std::string& name() const final
+    {
+        static const std::string _name{"tabulate"};
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        static const std::string _help{
+            // clang-format off
+            "\n"
+            "    Usage: 'expr' 'v' { x1 x2... xn } tabulate\n"
+            "\n"
+            "    Returns a list of the symbolic expression evaluated with\n"
+            "    the variable v set to each item of the list in turn, e.g.\n"
+            "    'sin(x)*x' 'x' 0 100 range tabulate. The items are\n"
+            "    evaluated in parallel. When the precision is no more than\n"
+            "    a hardware double holds and the expression only uses real\n"
+            "    numbers and common functions, float items are evaluated\n"
+            "    with doubles; exact items are always evaluated exactly.\n"
+            // clang-format on
+        };
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        // three args using num_args
+        stack_entry& e = calc.stack[2];
+        stack_entry& v = calc.stack[1];
+        stack_entry& l = calc.stack[0];
+        if (e.unit() != units::unit() || v.unit() != units::unit() ||
+            l.unit() != units::unit())
+        {
+            throw units_prohibited();
+        }
+        auto expr = std::get_if<symbolic>(&e.value());
+        if (!expr)
+        {
+            throw std::invalid_argument("'x' must be a symbolic expression");
+        }
+        auto var = std::get_if<symbolic>(&v.value());
+        const std::string* var_name = nullptr;
+        if (var && (**var).fn_ptr == invalid_function)
+        {
+            var_name = std::get_if<std::string>(&(**var).left);
+        }
+        if (!var_name)
+        {
+            throw std::invalid_argument("'y' must be a variable name");
+        }
+        auto lst = std::get_if<list>(&l.value());
+        if (!lst)
+        {
+            throw std::invalid_argument("'z' must be a list");
+        }
+
+        std::optional<symbolic_double_fn> fast{};
+        if (calc.config.fixed_bits == 0 &&
+            calc.config.precision <= std::numeric_limits<double>::digits10)
+        {
+            fast = expr->compile_double(calc, *var_name);
+        }
+        lg::debug("tabulate: {} items, {} path\n", lst->size(),
+                  fast ? "double" : "full");
+
+        std::vector<mpx> items(lst->size());
+        worker_pool::get().parallel_for(
+            lst->size(),
+            [&](size_t begin, size_t end) {
+                // forked on the first item that needs the full path
+                std::unique_ptr<Calculator> ctx{};
+                std::optional<Calculator::scoped_context> scope{};
+                for (size_t i = begin; i < end; i++)
+                {
+                    const mpx& x = lst->values[i];
+                    // only floats are already inexact; integers and
+                    // rationals must stay exact, so they take the full path
+                    if (fast && std::holds_alternative<mpf>(x))
+                    {
+                        double r =
+                            (*fast)(static_cast<double>(std::get<mpf>(x)));
+                        // anything else (complex results, poles) is
+                        // left for the full path to sort out
+                        if (std::isfinite(r))
+                        {
+                            items[i] = mpf{r};
+                            continue;
+                        }
+                    }
+                    if (!ctx)
+                    {
+                        ctx = calc.fork();
+                        scope.emplace(*ctx);
+                    }
+                    ctx->stack.clear();
+                    ctx->set_var(*var_name, variant_cast(x));
+                    expr->eval(*ctx);
+                    if (ctx->stack.size() != 1)
+                    {
+                        throw std::invalid_argument(
+                            "expression must evaluate to a single value");
+                    }
+                    items[i] = std::visit(
+                        [](const auto& a) -> mpx {
+                            if constexpr (is_one_of_v<decltype(a), mpx>)
+                            {
+                                return a;
+                            }
+                            else
+                            {
+                                throw std::invalid_argument(
+                                    "expression did not evaluate to a "
+                                    "number");
+                            }
+                        },
+                        ctx->stack.front().value());
+                }
+            },
+            fast ? 1024 : 16);
+
+        calc.stack.pop_front();
+        calc.stack.pop_front();
+        calc.stack.pop_front();
+        calc.stack.emplace_front(numeric{list{std::move(items)}},
+                                 calc.config.base, calc.config.fixed_bits,
+                                 calc.config.precision, calc.config.is_signed,
+                                 calc.flags);
+        return true;
+    }
+    int num_args() const final
+    {
+        return 3;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+};
+
 } // namespace function
 } // namespace smrty
 
 register_calc_fn(Eval);
+register_calc_fn(tabulate);
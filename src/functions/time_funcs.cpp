@@ -242,17 +242,13 @@ struct calendar : public CalcFunction
     }
     virtual bool op(Calculator& calc) const final
     {
-        if (calc.stack.size() < 1)
-        {
-            throw std::invalid_argument("Requires 1 argument");
-        }
-        stack_entry a = calc.stack.front();
-        const time_* t = std::get_if<time_>(&a.value());
+        stack_args<1> args(calc);
+        const time_* t = std::get_if<time_>(&args[0].value());
         if (!t || !t->absolute)
         {
             throw std::invalid_argument("Value must be an absolute time type");
         }
-        calc.stack.pop_front();
+        args.commit();
         // ymd is not time-zone aware
         auto tz_offset_nanos = []() {
             time_t gmt, ltime = time(NULL);
@@ -41,8 +41,11 @@ struct sine : public CalcFunction
                    {
                        throw units_prohibited();
                    }
-                   return scaled_trig_op(
-                       calc, a, [](const auto& a) { return sin_fn(a); });
+                   return scaled_trig_op(calc, a, [](const auto& a) {
+                       return hw_float_op(hw_fn::sin, a, [](const auto& a) {
+                           return sin_fn(a);
+                       });
+                   });
                });
     }
     int num_args() const final
@@ -89,8 +92,11 @@ struct cosine : public CalcFunction
                    {
                        throw units_prohibited();
                    }
-                   return scaled_trig_op(
-                       calc, a, [](const auto& a) { return cos_fn(a); });
+                   return scaled_trig_op(calc, a, [](const auto& a) {
+                       return hw_float_op(hw_fn::cos, a, [](const auto& a) {
+                           return cos_fn(a);
+                       });
+                   });
                });
     }
     int num_args() const final
@@ -137,8 +143,11 @@ struct tangent : public CalcFunction
                    {
                        throw units_prohibited();
                    }
-                   return scaled_trig_op(
-                       calc, a, [](const auto& a) { return tan_fn(a); });
+                   return scaled_trig_op(calc, a, [](const auto& a) {
+                       return hw_float_op(hw_fn::tan, a, [](const auto& a) {
+                           return tan_fn(a);
+                       });
+                   });
                });
     }
     int num_args() const final
@@ -340,7 +349,7 @@ struct arctangent2 : public CalcFunction
                    }
                    return scaled_trig_two_arg_op_inv(
                        calc, a, b, [](const auto& a, const auto& b) {
-                           auto pi = boost::math::constants::pi<mpf>();
+                           auto pi = get_constant(math_constant::pi);
                            auto zero = mpf{0};
                            auto pos = mpf{1};
                            auto neg = mpf{-1};
@@ -662,7 +671,7 @@ struct arccotangent : public CalcFunction
                    return scaled_trig_op_inv(calc, a, [](const auto& a) {
                        if constexpr (same_type_v<decltype(a), mpf>)
                        {
-                           auto pi = boost::math::constants::pi<mpf>();
+                           auto pi = get_constant(math_constant::pi);
                            if (a > decltype(a){0})
                            {
                                return atan_fn(mpf{1} / a);
@@ -119,6 +119,11 @@ struct define : public CalcFunction
                     throw std::invalid_argument(
                         "Variable already exists with this name");
                 }
+                if (calc.is_worker())
+                {
+                    throw std::invalid_argument(
+                        "Functions cannot be defined in a parallel context");
+                }
                 register_user_function(*n, program{*prog});
                 calc.stack.pop_front();
                 calc.stack.pop_front();
@@ -177,6 +182,12 @@ struct rm : public CalcFunction
                 }
                 else if (is_user_function(*n))
                 {
+                    if (calc.is_worker())
+                    {
+                        throw std::invalid_argument(
+                            "Functions cannot be removed in a parallel "
+                            "context");
+                    }
                     unregister_user_function(*n);
                 }
                 else
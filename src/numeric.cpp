@@ -4,18 +4,23 @@ Copyright © 2020 Vernon Mauery; All rights reserved.
 SPDX-License-Identifier: BSD-3-Clause
 */
 
+#include <bin_split.hpp>
 #include <calculator.hpp>
 #include <charconv>
 #include <chrono>
 #include <cmath>
+#include <concepts>
 #include <functions/common.hpp>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <numeric.hpp>
 #include <regex>
 #include <type_helpers.hpp>
 #include <variant>
 
-int default_precision = builtin_default_precision;
+thread_local int default_precision = builtin_default_precision;
 
 /*
  * make_quotient:
@@ -587,3 +592,179 @@ std::pair<mpz, mpq> divide_with_remainder(const mpq& value, const mpq& divisor)
     mpq rem = f - whole;
     return {whole, rem * divisor};
 }
+
+namespace smrty
+{
+
+namespace
+{
+
+// beyond this many digits, the parallel series engine is faster
+constexpr int bin_split_digits = 5000;
+
+mpf compute_constant(math_constant c)
+{
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    if (default_precision >= bin_split_digits)
+    {
+        switch (c)
+        {
+            case math_constant::pi:
+                return bin_split_pi(default_precision);
+            case math_constant::e:
+                return bin_split_e(default_precision);
+            case math_constant::ln2:
+                return bin_split_ln2(default_precision);
+            case math_constant::sqrt2:
+                return bin_split_sqrt2(default_precision);
+            default:
+                break;
+        }
+    }
+#endif
+    switch (c)
+    {
+        case math_constant::pi:
+            return boost::math::constants::pi<mpf>();
+        case math_constant::e:
+            return boost::math::constants::e<mpf>();
+        case math_constant::ln2:
+            return log_fn(mpf{2});
+        case math_constant::sqrt2:
+            return sqrt_fn(mpf{2});
+        case math_constant::rad_per_deg:
+            return get_constant(math_constant::pi) / mpf{180};
+        case math_constant::deg_per_rad:
+            return mpf{180} / get_constant(math_constant::pi);
+        case math_constant::rad_per_grad:
+            return get_constant(math_constant::pi) / mpf{200};
+        case math_constant::grad_per_rad:
+            return mpf{200} / get_constant(math_constant::pi);
+    }
+    throw std::invalid_argument("Unknown constant");
+}
+
+template <std::floating_point F>
+std::optional<F> hw_kernel(hw_fn f, F x)
+{
+    F y{};
+    F cond{};
+    switch (f)
+    {
+        case hw_fn::sin:
+            y = std::sin(x);
+            cond = x * std::cos(x) / y;
+            break;
+        case hw_fn::cos:
+            y = std::cos(x);
+            cond = x * std::sin(x) / y;
+            break;
+        case hw_fn::tan:
+            y = std::tan(x);
+            cond = x / (std::sin(x) * std::cos(x));
+            break;
+        case hw_fn::ln:
+            if (x <= F{0})
+            {
+                return std::nullopt;
+            }
+            y = std::log(x);
+            cond = F{1} / y;
+            break;
+        case hw_fn::sqrt:
+            if (x < F{0})
+            {
+                return std::nullopt;
+            }
+            y = std::sqrt(x);
+            cond = F{0.5};
+            break;
+    }
+    // rounding the argument costs an ulp times the condition number and the
+    // library functions are good to about an ulp; NaN fails the test too
+    F err = (std::abs(cond) + F{2}) * std::numeric_limits<F>::epsilon();
+    if (!std::isfinite(y) || !(err <= std::pow(F{10}, F(-default_precision))))
+    {
+        return std::nullopt;
+    }
+    return y;
+}
+
+template <std::floating_point F>
+std::optional<mpf> hw_float_eval_as(hw_fn f, const mpf& a)
+{
+    if (default_precision > std::numeric_limits<F>::digits10)
+    {
+        return std::nullopt;
+    }
+    auto x = static_cast<F>(a);
+    // out of range or denormal arguments lose too much in the conversion
+    if (!std::isnormal(x))
+    {
+        return std::nullopt;
+    }
+    if (auto y = hw_kernel<F>(f, x); y)
+    {
+        return mpf{*y};
+    }
+    return std::nullopt;
+}
+
+// round v down to the current precision
+void round_to_current(mpf& v)
+{
+#if defined(USE_GMP_BACKEND) || defined(USE_MPFR_BACKEND)
+    v.precision(default_precision);
+#else
+    // fixed precision types are always at the same precision
+    static_cast<void>(v);
+#endif
+}
+
+} // namespace
+
+std::optional<mpf> hw_float_eval(hw_fn f, const mpf& a)
+{
+#ifdef USE_BASIC_TYPES
+    // mpf already is a hardware type
+    static_cast<void>(f);
+    static_cast<void>(a);
+    return std::nullopt;
+#else
+    if (auto y = hw_float_eval_as<double>(f, a); y)
+    {
+        return y;
+    }
+    // __float128 would need libquadmath, which is not a dependency
+    return hw_float_eval_as<long double>(f, a);
+#endif
+}
+
+mpf get_constant(math_constant c)
+{
+    static std::mutex lock;
+    // values of each constant by precision
+    static std::map<math_constant, std::map<int, mpf>> cache;
+    int prec = default_precision;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto& values = cache[c];
+        if (auto v = values.lower_bound(prec); v != values.end())
+        {
+            mpf r = v->second;
+            if (v->first != prec)
+            {
+                round_to_current(r);
+            }
+            return r;
+        }
+    }
+    // compute without holding the lock; two threads may both compute it,
+    // but they get the same value
+    mpf v = compute_constant(c);
+    std::lock_guard<std::mutex> guard(lock);
+    cache[c].try_emplace(prec, v);
+    return v;
+}
+
+} // namespace smrty
@@ -12,6 +12,7 @@ SPDX-License-Identifier: BSD-3-Clause
 #include <debug.hpp>
 #include <exception.hpp>
 #include <format>
+#include <optional>
 #include <type_helpers.hpp>
 #include <variant>
 
@@ -727,6 +728,46 @@ auto operator/(const require_numeric_types auto& l,
 
 std::string mpz_to_bin_string(const mpz& v, std::streamsize width);
 
+namespace smrty
+{
+enum class math_constant
+{
+    pi,
+    e,
+    ln2,
+    sqrt2,
+    rad_per_deg,  // pi / 180
+    deg_per_rad,  // 180 / pi
+    rad_per_grad, // pi / 200
+    grad_per_rad, // 200 / pi
+};
+
+/*
+ * Returns the constant at the current precision. Each constant is computed
+ * the first time it is needed at a given precision and kept; if it was
+ * already computed at a higher precision, that value is rounded instead.
+ */
+mpf get_constant(math_constant c);
+
+// real functions that have a hardware floating point version
+enum class hw_fn
+{
+    sin,
+    cos,
+    tan,
+    ln,
+    sqrt,
+};
+
+/*
+ * Evaluates f(a) in double or long double if the current precision fits in
+ * that type and the estimated error (from the condition number of f at a)
+ * is within the current precision. Returns nothing if f(a) needs the
+ * multiprecision version.
+ */
+std::optional<mpf> hw_float_eval(hw_fn f, const mpf& a);
+} // namespace smrty
+
 namespace smrty
 {
 static inline numeric abs(const matrix& m)
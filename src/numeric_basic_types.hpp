@@ -40,7 +40,7 @@ SPDX-License-Identifier: BSD-3-Clause
 #define atanh_fn smrty::atanh
 
 static constexpr int builtin_default_precision = 6;
-extern int default_precision;
+extern thread_local int default_precision;
 static constexpr unsigned int max_precision = LDBL_DIG;
 static constexpr unsigned int max_bits = sizeof(long long) * 8;
 
@@ -51,6 +51,11 @@ static inline void set_default_precision(int iv)
     default_precision = iv;
 }
 
+static inline void set_thread_precision(int iv)
+{
+    default_precision = iv;
+}
+
 template <integer I>
 struct checked_int;
 
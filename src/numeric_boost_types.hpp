@@ -37,7 +37,9 @@ SPDX-License-Identifier: BSD-3-Clause
 #define acosh_fn acosh
 #define atanh_fn atanh
 
-extern int default_precision;
+// each thread carries its own working precision so that worker threads can
+// compute at the precision of the command that started them
+extern thread_local int default_precision;
 static constexpr int builtin_default_precision = 50;
 // yes, I know abritrary precision, but be reasonable, my dude!
 static constexpr unsigned int max_precision = 1000000;
@@ -84,6 +86,11 @@ static inline void set_default_precision(int iv)
     default_precision = iv;
 }
 
+static inline void set_thread_precision(int iv)
+{
+    default_precision = iv;
+}
+
 #elif defined(USE_GMP_BACKEND)
 static constexpr const char MATH_BACKEND[] = "boost::multiprecision::gmp_*";
 
@@ -103,6 +110,14 @@ static inline void set_default_precision(int iv)
         float_backend, boost::multiprecision::et_off>::default_precision(iv);
 }
 
+static inline void set_thread_precision(int iv)
+{
+    default_precision = iv;
+    boost::multiprecision::number<
+        float_backend,
+        boost::multiprecision::et_off>::thread_default_precision(iv);
+}
+
 #elif defined(USE_MPFR_BACKEND)
 static constexpr const char MATH_BACKEND[] = "boost::multiprecision::mpfr+gmp";
 
@@ -121,6 +136,14 @@ static inline void set_default_precision(int iv)
         float_backend, boost::multiprecision::et_off>::default_precision(iv);
 }
 
+static inline void set_thread_precision(int iv)
+{
+    default_precision = iv;
+    boost::multiprecision::number<
+        float_backend,
+        boost::multiprecision::et_off>::thread_default_precision(iv);
+}
+
 #endif // if/elif CPP / GMP / MPFR
 
 using mpz =
@@ -0,0 +1,388 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <algorithm>
+#include <array>
+#include <calculator.hpp>
+#include <ctrl_statements.hpp>
+#include <exception.hpp>
+#include <optimizer.hpp>
+#include <span>
+#include <string_view>
+#include <user_function.hpp>
+#include <utility>
+
+namespace smrty
+{
+
+namespace
+{
+
+// functions that are exact and only depend on their arguments
+constexpr auto foldable_functions = std::to_array<std::string_view>({
+    "!",
+    "*",
+    "+",
+    "-",
+    "/",
+    "^",
+    "abs",
+    "comb",
+    "gcd",
+    "lcm",
+    "neg",
+    "perm",
+    "sqr",
+});
+
+// binary functions that may be fused with the instruction before them
+constexpr auto fusable_functions = std::to_array<std::string_view>({
+    "*",
+    "+",
+    "-",
+    "/",
+});
+
+bool in_set(std::string_view name, std::span<const std::string_view> set)
+{
+    return std::find(set.begin(), set.end(), name) != set.end();
+}
+
+const function_parts* builtin_function(const simple_instruction& itm)
+{
+    auto f = std::get_if<function_parts>(&itm);
+    if (!f || !f->fn_ptr || f->re_args.size() ||
+        dynamic_pointer_cast<const UserFunction>(f->fn_ptr))
+    {
+        return nullptr;
+    }
+    return f;
+}
+
+bool is_exact_literal(const simple_instruction& itm)
+{
+    auto v = std::get_if<mpx>(&itm);
+    return v && (std::holds_alternative<mpz>(*v) ||
+                 std::holds_alternative<mpq>(*v));
+}
+
+bool is_named(const simple_instruction& itm, std::string_view name)
+{
+    auto f = builtin_function(itm);
+    return f && f->fn_ptr->name() == name;
+}
+
+// a super-instruction for one of the pairs that fused_args accepts: a
+// literal, dup or swap followed by a builtin binary function. It does the
+// first step in place and then runs the function, so the pair costs one
+// dispatch instead of two. run_one checks num_args (the arguments the
+// whole pair needs) before calling op, so the function's own check cannot
+// fail and the steps behave as they would unfused.
+struct fused_function : public CalcFunction
+{
+    enum class step
+    {
+        literal,
+        dup,
+        swap,
+    };
+
+    fused_function(simple_instructions&& parts, int args) :
+        _name(std::format("{: }", parts)), _help(), parts(std::move(parts)),
+        args(args)
+    {
+        _help = std::format("\n"
+                            "    Fused instructions: '{}'\n",
+                            _name);
+        if (auto v = std::get_if<mpx>(&this->parts[0]); v)
+        {
+            first = step::literal;
+            literal = *v;
+        }
+        else
+        {
+            first = is_named(this->parts[0], "dup") ? step::dup : step::swap;
+        }
+        binary = std::get<function_parts>(this->parts[1]).fn_ptr;
+    }
+    virtual const std::string& name() const final
+    {
+        return _name;
+    }
+    virtual const std::string& help() const final
+    {
+        return _help;
+    }
+    virtual bool op(Calculator& calc) const final
+    {
+        switch (first)
+        {
+            case step::literal:
+            {
+                // as run_one puts a literal on the stack
+                stack_entry e;
+                e.base = calc.config.base;
+                e.precision = calc.config.precision;
+                e.fixed_bits = calc.config.fixed_bits;
+                e.is_signed = calc.config.is_signed;
+                try
+                {
+                    e.value(variant_cast(literal), calc.flags);
+                }
+                catch (const std::exception& ex)
+                {
+                    lg::error("failed to parse '{}': {}\n", parts[0],
+                              ex.what());
+                    return false;
+                }
+                calc.stack.push_front(std::move(e));
+                break;
+            }
+            case step::dup:
+                calc.stack.push_front(stack_entry{calc.stack.front()});
+                break;
+            case step::swap:
+                std::swap(calc.stack[0], calc.stack[1]);
+                break;
+        }
+        return binary->op(calc);
+    }
+    int num_args() const final
+    {
+        return args;
+    }
+    int num_resp() const final
+    {
+        return 1;
+    }
+    symbolic_op symbolic_usage() const final
+    {
+        return symbolic_op::none;
+    }
+
+    std::string _name;
+    std::string _help;
+    simple_instructions parts;
+    int args;
+    step first;
+    mpx literal;
+    CalcFunction::ptr binary;
+};
+
+class optimizer
+{
+  public:
+    optimizer(optimizer_report& report, bool folding) :
+        report(report), folding(folding), ctx(Calculator::get().fork())
+    {
+        // folding is exact integer math
+        ctx->config.fixed_bits = 0;
+    }
+
+    program run(const program& prog)
+    {
+        program out{};
+        out.standalone = prog.standalone;
+        simple_instructions simple{};
+        auto flush = [this, &out, &simple]() {
+            for (auto& itm : run(std::move(simple)))
+            {
+                out.body.emplace_back(std::move(itm));
+            }
+            simple.clear();
+        };
+        for (const auto& i : prog.body)
+        {
+            if (auto s = std::get_if<simple_instruction>(&i); s)
+            {
+                simple.push_back(*s);
+            }
+            else if (auto s = std::get_if<statement::ptr>(&i); s && *s)
+            {
+                flush();
+                out.body.emplace_back(run(**s));
+            }
+        }
+        flush();
+        return out;
+    }
+
+  protected:
+    statement::ptr run(const statement& stmt)
+    {
+        auto copy = stmt.clone();
+        if (auto s = dynamic_pointer_cast<if_elif_statement>(copy); s)
+        {
+            for (auto& [test, cond, body] : s->branches)
+            {
+                cond = simple_program{run(std::move(cond.body))};
+                body = run(body);
+            }
+            s->current_branch = s->branches.begin();
+        }
+        else if (auto s = dynamic_pointer_cast<while_statement>(copy); s)
+        {
+            s->cond = simple_program{run(std::move(s->cond.body))};
+            s->body = run(s->body);
+        }
+        else if (auto s = dynamic_pointer_cast<for_statement>(copy); s)
+        {
+            s->setup = simple_program{run(std::move(s->setup.body))};
+            s->body = run(s->body);
+        }
+        else if (auto s = dynamic_pointer_cast<program>(copy); s)
+        {
+            *s = run(*s);
+        }
+        return copy;
+    }
+
+    simple_instructions run(simple_instructions&& in)
+    {
+        simple_instructions out{};
+        out.reserve(in.size());
+        for (auto& itm : in)
+        {
+            if (auto p = std::get_if<program>(&itm); p)
+            {
+                out.emplace_back(run(*p));
+                continue;
+            }
+            out.emplace_back(std::move(itm));
+            if (folding)
+            {
+                fold(out);
+            }
+        }
+        return fuse(std::move(out));
+    }
+
+    // if the last instruction is a pure function whose arguments are all
+    // exact literals, replace them all with the result
+    void fold(simple_instructions& out)
+    {
+        auto f = builtin_function(out.back());
+        if (!f || !in_set(f->fn_ptr->name(), foldable_functions))
+        {
+            return;
+        }
+        int args = f->fn_ptr->num_args();
+        if (args <= 0 || f->fn_ptr->num_resp() != 1 ||
+            out.size() < static_cast<size_t>(args + 1))
+        {
+            return;
+        }
+        auto first = out.end() - args - 1;
+        if (!std::all_of(first, out.end() - 1, is_exact_literal))
+        {
+            return;
+        }
+        Calculator::scoped_context scope(*ctx);
+        ctx->stack.clear();
+        try
+        {
+            for (auto it = first; it != out.end() - 1; it++)
+            {
+                ctx->run_one(*it);
+            }
+            f->fn_ptr->op(*ctx);
+        }
+        catch (const std::exception& e)
+        {
+            // leave it be; the error will happen when it runs
+            lg::debug("optimizer: not folding: {}\n", e.what());
+            return;
+        }
+        if (ctx->stack.size() != 1 ||
+            ctx->stack.front().unit() != units::unit())
+        {
+            return;
+        }
+        const numeric& v = ctx->stack.front().value();
+        mpx result{};
+        if (auto z = std::get_if<mpz>(&v); z)
+        {
+            result = *z;
+        }
+        else if (auto q = std::get_if<mpq>(&v); q)
+        {
+            result = *q;
+        }
+        else
+        {
+            return;
+        }
+        simple_instructions folded(first, out.end());
+        out.erase(first, out.end());
+        out.emplace_back(std::move(result));
+        report.push_back(
+            std::format("folded '{: }' to '{}'", folded, out.back()));
+    }
+
+    // replace common pairs with a single fused instruction
+    simple_instructions fuse(simple_instructions&& in)
+    {
+        simple_instructions out{};
+        out.reserve(in.size());
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            if ((i + 1) < in.size())
+            {
+                int args = fused_args(in[i], in[i + 1]);
+                if (args > 0)
+                {
+                    simple_instructions parts{in[i], in[i + 1]};
+                    auto fn = std::make_shared<fused_function>(
+                        std::move(parts), args);
+                    report.push_back(std::format("fused '{}'", fn->name()));
+                    out.emplace_back(function_parts{fn});
+                    i++;
+                    continue;
+                }
+            }
+            out.emplace_back(std::move(in[i]));
+        }
+        return out;
+    }
+
+    // returns the number of arguments for the fused pair or 0 if the
+    // pair cannot be fused
+    static int fused_args(const simple_instruction& a,
+                          const simple_instruction& b)
+    {
+        auto f = builtin_function(b);
+        if (!f || !in_set(f->fn_ptr->name(), fusable_functions))
+        {
+            return 0;
+        }
+        if (is_named(a, "dup") || std::holds_alternative<mpx>(a))
+        {
+            // dup *, 1 +, ...
+            return 1;
+        }
+        if (is_named(a, "swap"))
+        {
+            // swap -, swap /, ...
+            return 2;
+        }
+        return 0;
+    }
+
+    optimizer_report& report;
+    bool folding;
+    std::unique_ptr<Calculator> ctx;
+};
+
+} // namespace
+
+program optimize_program(const program& prog, optimizer_report& report,
+                         bool folding)
+{
+    optimizer opt{report, folding};
+    return opt.run(prog);
+}
+
+} // namespace smrty
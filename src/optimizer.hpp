@@ -0,0 +1,29 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+#pragma once
+
+#include <program.hpp>
+#include <string>
+#include <vector>
+
+namespace smrty
+{
+
+// one human readable line for each change the optimizer made
+using optimizer_report = std::vector<std::string>;
+
+/*
+ * Returns a copy of prog with runs of exact literals that feed pure
+ * functions folded into their result (2 3 * 10 + -> 16) and common pairs
+ * (dup *, swap -, 1 +, ...) fused into a single program step. Fused
+ * instructions print as the text they replaced. Folding uses unlimited
+ * integer math, so a folded result must only be run when fixed_bits is
+ * not set; pass folding = false to only fuse.
+ */
+program optimize_program(const program& prog, optimizer_report& report,
+                         bool folding = true);
+
+} // namespace smrty
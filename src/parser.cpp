@@ -248,13 +248,15 @@ bp::rule<class paren_expr, symbolic> const paren_expr =
     "Parenthetic expression";
 bp::rule<class paren_fn, function_parts> const paren_fn = "symbolic function";
 bp::rule<class paren_fn_call, symbolic> const paren_fn_call = "Function call";
-bp::rule<class expr_atomic, symbolic> const expr_atomic = "Atomic expression";
-bp::rule<class factorial, symbolic> const factorial = "Factorial";
-bp::rule<class expon, symbolic> const expon = "Exponentiation";
-bp::rule<class negation, symbolic> const negation = "Negation";
-bp::rule<class multdiv, symbolic> const multdiv = "Multiplication or division";
-bp::rule<class addsub, symbolic> const addsub = "Addition or subtraction";
-bp::rule<class equation, symbolic> const equation = "Equation";
+// operands and pending operators of one (parenthesized) expression; the
+// operators are the infix characters or 'n' for prefix negation
+struct expr_builder
+{
+    std::vector<symbolic> operands;
+    std::vector<char> ops;
+};
+bp::rule<class expression, symbolic, expr_builder> const expression =
+    "Expression";
 bp::rule<class symbolic_r, symbolic> const symbolic_r = "Symbolic expression";
 /*
 auto const add_symbol = [](auto& ctx) {
@@ -374,7 +376,19 @@ auto const parse_instruction = [](auto& ctx) {
     // print_ctx_types(parse_instruction);
     // parse_instruction: attr is a instruction (maybe not same order?)
     //                     val is a instruction
-    std::visit([&val](auto& a) { val = a; }, attr);
+    std::visit(
+        [&val](auto& a) {
+            if constexpr (same_type_v<decltype(a), symbolic>)
+            {
+                // finished expressions are shared, see symbolic::interned
+                val = a.interned();
+            }
+            else
+            {
+                val = a;
+            }
+        },
+        attr);
 };
 
 auto const parse_simple_instruction = [](auto& ctx) {
@@ -886,16 +900,6 @@ auto const parse_variable = [](auto& ctx) {
     lg::debug("                val={}, attr={}\n", val, attr);
 };
 
-[[maybe_unused]] auto const parse_factorial = [](auto& ctx) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    print_ctx_types(parse_factorial);
-    lg::debug("parse_factorial: val={}, attr={}\n", val, attr);
-    (*val).fn_ptr = smrty::fn_get_fn_ptr_by_name("!");
-    (*val).fn_style = symbolic_op::postfix;
-    lg::debug("                 val={}, attr={}\n", val, attr);
-};
-
 auto const parse_expr_passthru_n = [](auto& ctx, int n) {
     const auto& attr = _attr(ctx);
     auto& val = _val(ctx);
@@ -912,117 +916,134 @@ auto const parse_expr_passthru_n = [](auto& ctx, int n) {
     lg::debug("                        val={} <<- attr={}\n", val, attr);
 };
 
-auto const parse_expr_left_n = [](auto& ctx, int n) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    // print_ctx_types(parse_expr_left);
-    lg::debug("parse_expr_left({}): val={} left <<- attr={}\n", n, val, attr);
-    // if left is an atomic (number or variable) we need to copy it in
-    // from the .left or .right
-    // otherwise, we pull in the whole symbolic
-    if ((*attr).fn_ptr == smrty::invalid_function)
-    {
-        if (std::get_if<std::monostate>(&((*attr).left)))
-        {
-            (*val).left = (*attr).right;
-        }
-        else
-        {
-            (*val).left = (*attr).left;
-        }
-    }
-    else
+// precedence climbing for quoted expressions: operands and operators are
+// pushed as they are parsed and reduced as soon as an operator of lower (or
+// equal, for left associative operators) precedence shows up, so a long
+// expression is parsed in one pass without any backtracking
+int expr_precedence(char op)
+{
+    switch (op)
     {
-        (*val).left = attr;
+        case '=':
+            return 1;
+        case '+':
+        case '-':
+            return 2;
+        case '*':
+        case '/':
+        case '%':
+            return 3;
+        case 'n':
+            return 4;
+        case '^':
+            return 5;
     }
-    lg::debug("                    val={} left <<- attr={}\n", val, attr);
-};
+    return 0;
+}
 
-auto const parse_negation_left = [](auto& ctx) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    // print_ctx_types(parse_negation_left);
-    lg::debug("parse_negation_left: val={} left <<- attr={}\n", val, attr);
-    // attr should always have the value on the left
-    // if attr.left is a number_parts, negate and turn val into an atomic
-    (*val).left = (*attr).left;
-    if ((*attr).fn_ptr == smrty::invalid_function)
+// numbers and variables are stored directly in their parent
+symbolic_operand expr_operand(const symbolic& s)
+{
+    const symbolic_actual& n = *s;
+    if (n.fn_ptr == smrty::invalid_function && n.fn_style == symbolic_op::none)
     {
-        if (auto l = std::get_if<mpx>(&((*val).left)); l)
-        {
-            // negate the value and set val function to invalid
-            *l = std::visit(
-                [](const auto& v) -> mpx { return decltype(v){-1} * v; }, *l);
-            (*val).fn_ptr = smrty::invalid_function;
-            (*val).fn_style = smrty::symbolic_op::none;
-        }
+        return n.left;
     }
-    lg::debug("                     val={} left <<- attr={}\n", val, attr);
-};
+    return s;
+}
 
-auto const parse_expr_right_n = [](auto& ctx, int n) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    // print_ctx_types(parse_expr_right);
-    lg::debug("parse_expr_right({}): val={} right <<- attr={}\n", n, val, attr);
-    if ((*attr).fn_ptr == smrty::invalid_function)
+void expr_reduce(expr_builder& b)
+{
+    char op = b.ops.back();
+    b.ops.pop_back();
+    symbolic node{};
+    if (op == 'n')
     {
-        if (std::get_if<std::monostate>(&((*attr).right)))
+        symbolic a = std::move(b.operands.back());
+        b.operands.pop_back();
+        const symbolic_actual& n = *std::as_const(a);
+        auto v = std::get_if<mpx>(&n.left);
+        if (v && n.fn_ptr == smrty::invalid_function)
         {
-            (*val).right = (*attr).left;
+            // a negated number is just a negative number
+            (*node).left = std::visit(
+                [](const auto& x) -> mpx {
+                    return std::decay_t<decltype(x)>{-1} * x;
+                },
+                *v);
         }
         else
         {
-            (*val).right = (*attr).right;
+            (*node).fn_ptr = smrty::fn_get_fn_ptr_by_name("-");
+            (*node).fn_style = symbolic_op::prefix;
+            (*node).left = expr_operand(a);
         }
     }
     else
     {
-        (*val).right = attr;
+        symbolic right = std::move(b.operands.back());
+        b.operands.pop_back();
+        symbolic left = std::move(b.operands.back());
+        b.operands.pop_back();
+        (*node).fn_ptr = smrty::fn_get_fn_ptr_by_name(std::string_view{&op, 1});
+        (*node).fn_style = symbolic_op::infix;
+        (*node).left = expr_operand(left);
+        (*node).right = expr_operand(right);
     }
-    lg::debug("                  val={} right <<- attr={}\n", val, attr);
+    b.operands.push_back(std::move(node));
+}
+
+auto const expr_push_number = [](auto& ctx) {
+    symbolic leaf{};
+    (*leaf).left = _attr(ctx);
+    _locals(ctx).operands.push_back(std::move(leaf));
 };
 
-auto const parse_expr_op = [](auto& ctx) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    // print_ctx_types(parse_expr_op);
-    lg::debug("parse_expr_op: val={}, attr={}\n", val, attr);
-    std::string_view v{&attr, 1};
-    if ((*val).fn_ptr == smrty::invalid_function)
-    {
-        (*val).fn_style = symbolic_op::infix;
-        (*val).fn_ptr = smrty::fn_get_fn_ptr_by_name(v);
-    }
-    else
-    {
-        auto left = val;
-        val = symbolic();
-        (*val).left = left;
-        (*val).fn_style = symbolic_op::infix;
-        (*val).fn_ptr = smrty::fn_get_fn_ptr_by_name(v);
-    }
-    lg::debug("               val={}, attr={}\n", val, attr);
+auto const expr_push_operand = [](auto& ctx) {
+    _locals(ctx).operands.push_back(_attr(ctx));
 };
 
-auto const parse_negation = [](auto& ctx) {
-    [[maybe_unused]] const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    // print_ctx_types(parse_negation);
-    lg::debug("parse_negation: val={}, attr={}\n", val, attr);
-    (*val).fn_ptr = smrty::fn_get_fn_ptr_by_name("-");
-    (*val).fn_style = symbolic_op::prefix;
-    lg::debug("                val={}, attr={}\n", val, attr);
+auto const expr_push_prefix = [](auto& ctx) {
+    // binds tighter than anything but ^ and !, so it waits to be reduced
+    _locals(ctx).ops.push_back('n');
 };
 
-auto const parse_number_expr = [](auto& ctx) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    // print_ctx_types(parse_number_expr);
-    lg::debug("parse_number_expr: val={}, attr={}\n", val, attr);
-    (*val).fn_ptr = smrty::invalid_function;
-    (*val).left = attr;
-    lg::debug("                   val={}, attr={}\n", val, attr);
+auto const expr_push_postfix = [](auto& ctx) {
+    // ! binds tightest, so it applies right away to the last operand
+    auto& operands = _locals(ctx).operands;
+    symbolic node{};
+    (*node).fn_ptr = smrty::fn_get_fn_ptr_by_name("!");
+    (*node).fn_style = symbolic_op::postfix;
+    (*node).left = expr_operand(operands.back());
+    operands.back() = std::move(node);
+};
+
+auto const expr_push_infix = [](auto& ctx) {
+    char op = _attr(ctx);
+    auto& b = _locals(ctx);
+    int prec = expr_precedence(op);
+    // ^ is right associative, the rest are left associative
+    bool left_assoc = op != '^';
+    while (b.ops.size())
+    {
+        int top = expr_precedence(b.ops.back());
+        if (top < prec || (top == prec && !left_assoc))
+        {
+            break;
+        }
+        expr_reduce(b);
+    }
+    b.ops.push_back(op);
+};
+
+auto const expr_finish = [](auto& ctx) {
+    auto& b = _locals(ctx);
+    while (b.ops.size())
+    {
+        expr_reduce(b);
+    }
+    _val(ctx) = std::move(b.operands.back());
+    lg::debug("expression: {}\n", _val(ctx));
 };
 
 auto const store_expr_fn = [](auto& ctx) {
@@ -1035,122 +1056,33 @@ auto const store_expr_fn = [](auto& ctx) {
     lg::debug("               val={}, attr={}\n", val, attr);
 };
 
-[[maybe_unused]] auto const parse_expr_passthru_1 = [](const auto& ctx) {
+auto const parse_expr_passthru_1 = [](const auto& ctx) {
     return parse_expr_passthru_n(ctx, 1);
 };
-[[maybe_unused]] auto const parse_expr_passthru_2 = [](const auto& ctx) {
+auto const parse_expr_passthru_2 = [](const auto& ctx) {
     return parse_expr_passthru_n(ctx, 2);
 };
-[[maybe_unused]] auto const parse_expr_passthru_3 = [](const auto& ctx) {
+auto const parse_expr_passthru_3 = [](const auto& ctx) {
     return parse_expr_passthru_n(ctx, 3);
 };
-[[maybe_unused]] auto const parse_expr_passthru_4 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 4);
-};
-[[maybe_unused]] auto const parse_expr_passthru_6 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 6);
-};
-[[maybe_unused]] auto const parse_expr_passthru_5 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 5);
-};
-[[maybe_unused]] auto const parse_expr_passthru_7 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 7);
-};
-[[maybe_unused]] auto const parse_expr_passthru_8 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 8);
-};
-[[maybe_unused]] auto const parse_expr_passthru_9 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 9);
-};
-[[maybe_unused]] auto const parse_expr_passthru_10 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 10);
-};
-[[maybe_unused]] auto const parse_expr_passthru_11 = [](const auto& ctx) {
-    return parse_expr_passthru_n(ctx, 11);
-};
-
-[[maybe_unused]] auto const parse_expr_left_1 = [](const auto& ctx) {
-    return parse_expr_left_n(ctx, 1);
-};
-[[maybe_unused]] auto const parse_expr_left_2 = [](const auto& ctx) {
-    return parse_expr_left_n(ctx, 2);
-};
-[[maybe_unused]] auto const parse_expr_left_3 = [](const auto& ctx) {
-    return parse_expr_left_n(ctx, 3);
-};
-[[maybe_unused]] auto const parse_expr_left_4 = [](const auto& ctx) {
-    return parse_expr_left_n(ctx, 4);
-};
-[[maybe_unused]] auto const parse_expr_left_5 = [](const auto& ctx) {
-    return parse_expr_left_n(ctx, 5);
-};
-[[maybe_unused]] auto const parse_expr_right_1 = [](const auto& ctx) {
-    return parse_expr_right_n(ctx, 1);
-};
-[[maybe_unused]] auto const parse_expr_right_2 = [](const auto& ctx) {
-    return parse_expr_right_n(ctx, 2);
-};
-[[maybe_unused]] auto const parse_expr_right_3 = [](const auto& ctx) {
-    return parse_expr_right_n(ctx, 3);
-};
-[[maybe_unused]] auto const parse_expr_right_4 = [](const auto& ctx) {
-    return parse_expr_right_n(ctx, 4);
-};
-[[maybe_unused]] auto const parse_expr_right_5 = [](const auto& ctx) {
-    return parse_expr_right_n(ctx, 5);
-};
-[[maybe_unused]] auto const parse_passthru_noop = [](const auto& ctx) {
-    [[maybe_unused]] const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    lg::debug("parse_passthru_noop: val={}\n", val);
-};
-// 2+3+4
-//     +
-//   +   4
-// 2   3
-[[maybe_unused]] auto const parse_junk = [](const auto& ctx) {
-    const auto& attr = _attr(ctx);
-    auto& val = _val(ctx);
-    print_ctx_types(parse_junk);
-};
 
 // all symbolic instruction types make symbolic
 auto const variable_def = (+bp::char_('a', 'z'))[parse_variable];
-auto const paren_expr_def = "("_l > addsub[parse_expr_passthru_1] > ")"_l;
+auto const paren_expr_def = "("_l > expression[parse_expr_passthru_1] > ")"_l;
 auto const paren_fn_def = paren_op[parse_function];
 auto const paren_fn_call_def =
     paren_fn[store_expr_fn] > paren_expr[parse_expr_passthru_2];
-auto const expr_atomic_def =
-    number_r[parse_number_expr] |
-    (paren_expr | paren_fn_call | variable)[parse_expr_passthru_3];
-auto const factorial_def =
-    (expr_atomic[parse_expr_passthru_4] >> bp::char_("!"))[parse_factorial] |
-    expr_atomic[parse_passthru_noop];
-auto const expon_def =
-    (factorial[parse_expr_left_1] >> bp::char_("^")[parse_expr_op] >>
-     factorial[parse_expr_right_1]) |
-    factorial[parse_expr_passthru_6];
-auto const negation_def =
-    (bp::string("-")[parse_negation] >> expon[parse_negation_left]) |
-    expon[parse_expr_passthru_7];
-auto const multdiv_def = (negation[parse_expr_left_3] >>
-                          bp::char_("*/%")[parse_expr_op] >>
-                          negation[parse_expr_right_3]) >>
-                             *(bp::char_("*/%")[parse_expr_op] >>
-                               negation[parse_expr_right_4]) |
-                         negation[parse_expr_passthru_8];
-auto const addsub_def = (multdiv[parse_expr_left_3] >>
-                         bp::char_("+-")[parse_expr_op] >>
-                         multdiv[parse_expr_right_3]) >>
-                            *(bp::char_("+-")[parse_expr_op] >>
-                              multdiv[parse_expr_right_4]) |
-                        multdiv[parse_expr_passthru_9];
-auto const equation_def =
-    (addsub[parse_expr_left_5] >> bp::char_("=")[parse_expr_op] >>
-     addsub[parse_expr_right_5]) |
-    addsub[parse_expr_passthru_10];
+// an operand with any leading negations and trailing factorials
+auto const expr_operand_r =
+    *bp::char_('-')[expr_push_prefix] >>
+    (number_r[expr_push_number] |
+     (paren_expr | paren_fn_call | variable)[expr_push_operand]) >>
+    *bp::char_('!')[expr_push_postfix];
+auto const expression_def =
+    (expr_operand_r >>
+     *(bp::char_("+-*/%^=")[expr_push_infix] >> expr_operand_r))[expr_finish];
 auto const symbolic_r_def = "'"_l[set_no_commas] >
-                            equation[parse_expr_passthru_11] >
+                            expression[parse_expr_passthru_3] >
                             "'"_l[set_commas_ok];
 
 BOOST_PARSER_DEFINE_RULES(uinteger, integer, ufloating, floating, rati0nal,
@@ -1161,8 +1093,7 @@ BOOST_PARSER_DEFINE_RULES(uinteger, integer, ufloating, floating, rati0nal,
                           comment, user_input);
 
 BOOST_PARSER_DEFINE_RULES(variable, paren_expr, paren_fn, paren_fn_call,
-                          expr_atomic, factorial, expon, negation, multdiv,
-                          addsub, equation, symbolic_r);
+                          expression, symbolic_r);
 
 std::span<std::string_view> function_names;
 int current_base_actual = 10;
@@ -46,6 +46,25 @@ namespace smrty
 // next
 //
 
+// copy simple instructions and clone control statements
+static instructions copy_instructions(const instructions& src)
+{
+    instructions out;
+    out.reserve(src.size());
+    for (const auto& i : src)
+    {
+        if (auto s = std::get_if<statement::ptr>(&i); s && *s)
+        {
+            out.emplace_back((*s)->clone());
+        }
+        else
+        {
+            out.emplace_back(i);
+        }
+    }
+    return out;
+}
+
 program::program() : body(), next(body.begin()), standalone(false)
 {
 }
@@ -56,7 +75,8 @@ program::program(const instructions& i) :
 }
 
 program::program(const program& o) :
-    body(o.body), next(body.begin()), standalone(o.standalone)
+    body(copy_instructions(o.body)), next(body.begin()),
+    standalone(o.standalone)
 {
 }
 
@@ -67,7 +87,7 @@ program::program(program&& o) :
 
 program& program::operator=(const program& o)
 {
-    body = o.body;
+    body = copy_instructions(o.body);
     next = body.begin();
     standalone = o.standalone;
     return *this;
@@ -85,51 +105,75 @@ program::~program()
 {
 }
 
-const simple_instruction& program::next_item(execution_flags& flags)
+statement::ptr program::clone() const
 {
-    if (next != body.end())
+    return std::make_shared<program>(*this);
+}
+
+void program::reset()
+{
+    next = body.begin();
+}
+
+statement::step_result program::step(execution_flags&)
+{
+    if (next == body.end())
     {
-        if (auto s = std::get_if<simple_instruction>(&(*next)); s)
-        {
-            next++;
-            return *s;
-        }
-        // control statements
-        else if (auto s = std::get_if<statement::ptr>(&(*next)); s)
-        {
-            lg::debug("ctrl-statement: {}\n", *s);
-            if (const auto& itm = (*s)->next_item(flags); !is_noop(itm))
-            {
-                return itm;
-            }
-            next++;
-            // recurse
-            return next_item(flags);
-        }
+        return {};
     }
-    next = body.begin();
-    return noop;
+    const auto& i = *next++;
+    if (auto s = std::get_if<simple_instruction>(&i); s)
+    {
+        return {s, nullptr};
+    }
+    // control statements
+    const auto& s = std::get<statement::ptr>(i);
+    lg::debug("ctrl-statement: {}\n", s);
+    return {nullptr, s.get()};
 }
 
 bool program::execute(const Executor& executor, execution_flags& flags)
 {
-    // reset program counter to beginning
-    next = body.begin();
-
     bool last_show_stack = true;
 
     lg::debug("program::execute()\n");
-    while (1)
+    // The running statements are kept in an explicit stack rather than
+    // nested calls, so native stack use does not grow with nesting depth.
+    std::vector<statement*> frames{this};
+    reset();
+    while (frames.size())
     {
-        const auto& itm = next_item(flags);
-        lg::debug("program: next_item = {}\n", itm);
-        if (is_noop(itm))
+        auto [itm, child] = frames.back()->step(flags);
+        if (child)
         {
-            lg::debug("program::execute() - end of program\n");
-            break;
+            child->reset();
+            frames.push_back(child);
+            continue;
+        }
+        if (!itm)
+        {
+            frames.pop_back();
+            continue;
+        }
+        lg::debug("program: next_item = {}\n", *itm);
+        if (auto k = std::get_if<keyword>(itm);
+            k && (k->word == "break" || k->word == "continue"))
+        {
+            // unwind to the innermost loop
+            size_t depth = frames.size();
+            while (depth && !frames[depth - 1]->loop_control(*k))
+            {
+                depth--;
+            }
+            if (depth)
+            {
+                frames.resize(depth);
+                continue;
+            }
         }
-        last_show_stack = executor(itm, flags);
+        last_show_stack = executor(*itm, flags);
     }
+    lg::debug("program::execute() - end of program\n");
     return last_show_stack;
 }
 
@@ -174,14 +218,23 @@ simple_program::~simple_program()
 {
 }
 
-const simple_instruction& simple_program::next_item(execution_flags&)
+statement::ptr simple_program::clone() const
+{
+    return std::make_shared<simple_program>(*this);
+}
+
+void simple_program::reset()
+{
+    next = body.begin();
+}
+
+statement::step_result simple_program::step(execution_flags&)
 {
     if (next != body.end())
     {
-        return *next++;
+        return {&(*next++), nullptr};
     }
-    next = body.begin();
-    return noop;
+    return {};
 }
 
 } // namespace smrty
@@ -30,7 +30,9 @@ struct program : public statement
     program& operator=(program&&);
     virtual ~program();
 
-    virtual const simple_instruction& next_item(execution_flags&) final;
+    virtual void reset() final;
+    virtual step_result step(execution_flags&) final;
+    virtual statement::ptr clone() const final;
     bool execute(const Executor&, execution_flags&);
     void quit();
     bool done();
@@ -50,7 +52,9 @@ struct simple_program : public statement
     simple_program& operator=(simple_program&&);
     virtual ~simple_program();
 
-    virtual const simple_instruction& next_item(execution_flags&) final;
+    virtual void reset() final;
+    virtual step_result step(execution_flags&) final;
+    virtual statement::ptr clone() const final;
 
     simple_instructions body;
     simple_instructions::iterator next;
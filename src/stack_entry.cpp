@@ -4,14 +4,49 @@ Copyright © 2024 Vernon Mauery; All rights reserved.
 SPDX-License-Identifier: BSD-3-Clause
 */
 
+#include <chrono>
+#include <exception>
 #include <stack_entry.hpp>
 
 namespace smrty
 {
 
+bool stack_entry::ready() const
+{
+    return !_pending.valid() ||
+           _pending.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready;
+}
+
+void stack_entry::resolve() const
+{
+    pending_result r;
+    try
+    {
+        r = _pending.get();
+    }
+    catch (const std::exception& e)
+    {
+        throw std::runtime_error(
+            std::format("'{}' failed: {}", _pending_desc, e.what()));
+    }
+    _pending = {};
+    _unit = std::get<smrty::units::unit>(r);
+    // storing does not change anything that makes this entry what it is
+    const_cast<stack_entry*>(this)->store_value(
+        std::move(std::get<numeric>(r)));
+}
+
+
 void stack_entry::store_value(numeric&& v)
 {
+    _pending = {};
     _value = reduce_numeric(v, precision);
+    if (auto s = std::get_if<symbolic>(&_value); s)
+    {
+        // symbolics on the stack are always the shared, interned form
+        *s = s->interned();
+    }
     if (mpz* v = std::get_if<mpz>(&_value); fixed_bits && v != nullptr)
     {
         execution_flags dummy{};
@@ -38,7 +73,13 @@ void stack_entry::store_value(numeric&& v)
 
 void stack_entry::store_value(numeric&& v, execution_flags& flags)
 {
+    _pending = {};
     _value = reduce_numeric(v, precision);
+    if (auto s = std::get_if<symbolic>(&_value); s)
+    {
+        // symbolics on the stack are always the shared, interned form
+        *s = s->interned();
+    }
     if (mpz* v = std::get_if<mpz>(&_value); fixed_bits && v != nullptr)
     {
         emulate_int_types(*v, flags);
@@ -5,7 +5,10 @@ SPDX-License-Identifier: BSD-3-Clause
 */
 #pragma once
 
+#include <future>
 #include <numeric.hpp>
+#include <string>
+#include <tuple>
 #include <units.hpp>
 
 namespace smrty
@@ -33,8 +36,23 @@ class stack_entry
         store_value(std::move(v), flags);
     }
 
+    using pending_result = std::tuple<numeric, smrty::units::unit>;
+
+    // a placeholder for a value that is still being computed elsewhere;
+    // it resolves in place the first time the value is needed
+    stack_entry(std::shared_future<pending_result>&& r, std::string_view desc,
+                int b, int f, int p, bool s) :
+        _value(), _unit(), _pending(std::move(r)), _pending_desc(desc),
+        base(b), fixed_bits(f), precision(p), is_signed(s)
+    {
+    }
+
     const numeric& value() const
     {
+        if (_pending.valid())
+        {
+            resolve();
+        }
         return _value;
     }
 
@@ -48,12 +66,36 @@ class stack_entry
         store_value(numeric{n}, flags);
     }
 
+    void value(numeric&& n)
+    {
+        store_value(std::move(n));
+    }
+
+    // move the value out, leaving this entry empty; used by operations
+    // that consume their arguments
+    numeric take_value()
+    {
+        if (_pending.valid())
+        {
+            resolve();
+        }
+        return std::move(_value);
+    }
+
     const smrty::units::unit& unit() const
     {
+        if (_pending.valid())
+        {
+            resolve();
+        }
         return _unit;
     }
     smrty::units::unit& unit()
     {
+        if (_pending.valid())
+        {
+            resolve();
+        }
         return _unit;
     }
     void unit(const smrty::units::unit& u)
@@ -65,15 +107,33 @@ class stack_entry
         _unit = smrty::units::unit(u);
     }
 
+    // true while the value is still a placeholder (computing or failed)
+    bool pending() const
+    {
+        return _pending.valid();
+    }
+    // true if value() would not have to wait
+    bool ready() const;
+    const std::string& description() const
+    {
+        return _pending_desc;
+    }
+
   protected:
     void store_value(numeric&& v);
     void store_value(numeric&& v, execution_flags& flags);
 
     void emulate_int_types(mpz& v, execution_flags& flags);
 
+    // wait for a pending value and store it; rethrows its failure
+    void resolve() const;
+
   protected:
-    numeric _value;
-    smrty::units::unit _unit;
+    // a pending value is filled in by the const accessors
+    mutable numeric _value;
+    mutable smrty::units::unit _unit;
+    mutable std::shared_future<pending_result> _pending;
+    std::string _pending_desc;
 
   public:
     int base;
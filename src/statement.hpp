@@ -47,8 +47,27 @@ struct statement
 {
     using ptr = std::shared_ptr<statement>;
 
+    // The result of one step of a statement: an instruction to run, a
+    // child statement to run to completion before the next step, or
+    // neither once the statement is finished.
+    struct step_result
+    {
+        const simple_instruction* itm = nullptr;
+        statement* child = nullptr;
+    };
+
     virtual ~statement() = default;
-    virtual const simple_instruction& next_item(execution_flags&) = 0;
+    // prepare to run from the beginning
+    virtual void reset() = 0;
+    virtual step_result step(execution_flags&) = 0;
+    // loops take break/continue and return true; others return false
+    virtual bool loop_control(const keyword&)
+    {
+        return false;
+    }
+    // statements carry execution state, so copies of a program each need
+    // their own copy of the statements rather than a shared pointer
+    virtual ptr clone() const = 0;
 };
 
 // TODO: add control statement types to instruction variant
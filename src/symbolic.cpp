@@ -4,9 +4,14 @@ Copyright © 2024 Vernon Mauery; All rights reserved.
 SPDX-License-Identifier: BSD-3-Clause
 */
 
+#include <algorithm>
+#include <array>
 #include <calculator.hpp>
+#include <cmath>
+#include <mutex>
 #include <numeric.hpp>
 #include <symbolic.hpp>
+#include <unordered_map>
 
 namespace smrty
 {
@@ -32,77 +37,526 @@ namespace smrty
                          var(y)  num(2)
 */
 
-symbolic::symbolic() : ptr(std::make_shared<symbolic_actual>(*this))
+namespace
 {
+
+size_t hash_combine(size_t seed, size_t v)
+{
+    return seed ^ (v + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+// hashes of the values themselves, so they do not depend on the precision
+// that numbers are displayed with
+#if (USE_BOOST_CPP_BACKEND || USE_GMP_BACKEND || USE_MPFR_BACKEND)
+size_t value_hash(const auto& v)
+{
+    // boost::multiprecision hashes the limbs, exponent and sign
+    return hash_value(v);
+}
+#else
+size_t value_hash(const mpz& v)
+{
+    return std::hash<mpz::value_type>{}(v.value);
+}
+size_t value_hash(const mpf& v)
+{
+    return std::hash<mpf::value_type>{}(v.value);
+}
+size_t value_hash(const mpq& v)
+{
+    return hash_combine(value_hash(v.numerator()),
+                        value_hash(v.denominator()));
+}
+size_t value_hash(const mpc& v)
+{
+    return hash_combine(std::hash<mpc::value_type>{}(v.real()),
+                        std::hash<mpc::value_type>{}(v.imag()));
+}
+#endif
+
+size_t operand_hash(const symbolic_operand& o)
+{
+    size_t h = o.index();
+    if (auto s = std::get_if<symbolic>(&o); s)
+    {
+        h = hash_combine(h, (**s).hash);
+    }
+    else if (auto s = std::get_if<std::string>(&o); s)
+    {
+        h = hash_combine(h, std::hash<std::string>{}(*s));
+    }
+    else if (auto v = std::get_if<mpx>(&o); v)
+    {
+        h = hash_combine(h, v->index());
+        h = hash_combine(
+            h, std::visit([](const auto& x) { return value_hash(x); }, *v));
+    }
+    return h;
+}
+
+// children are interned, so they are equal only if they are the same node
+bool same_operand(const symbolic_operand& a, const symbolic_operand& b)
+{
+    if (a.index() != b.index())
+    {
+        return false;
+    }
+    if (auto s = std::get_if<symbolic>(&a); s)
+    {
+        return &(**s) == &(*std::get<symbolic>(b));
+    }
+    if (auto s = std::get_if<std::string>(&a); s)
+    {
+        return *s == std::get<std::string>(b);
+    }
+    if (auto v = std::get_if<mpx>(&a); v)
+    {
+        const mpx& w = std::get<mpx>(b);
+        return v->index() == w.index() &&
+               std::visit(
+                   [&w](const auto& x) {
+                       return x == std::get<std::decay_t<decltype(x)>>(w);
+                   },
+                   *v);
+    }
+    return true;
+}
+
+/*
+ * All of the interned nodes, by hash. The table does not keep nodes
+ * alive; entries for nodes that are gone are swept out as it grows.
+ */
+class intern_table
+{
+  public:
+    static intern_table& get()
+    {
+        static intern_table _this{};
+        return _this;
+    }
+
+    // returns the interned node equal to node, adding node if needed
+    std::shared_ptr<symbolic_actual>
+        insert(std::shared_ptr<symbolic_actual>&& node)
+    {
+        size_t h = hash_combine(std::hash<const void*>{}(node->fn_ptr.get()),
+                                static_cast<size_t>(node->fn_style));
+        h = hash_combine(h, operand_hash(node->left));
+        h = hash_combine(h, operand_hash(node->right));
+        node->hash = h;
+
+        std::lock_guard<std::mutex> guard(lock);
+        auto [first, last] = nodes.equal_range(h);
+        for (auto it = first; it != last; it++)
+        {
+            auto n = it->second.lock();
+            if (n && n->fn_ptr == node->fn_ptr &&
+                n->fn_style == node->fn_style &&
+                same_operand(n->left, node->left) &&
+                same_operand(n->right, node->right))
+            {
+                return n;
+            }
+        }
+        if (nodes.size() >= sweep_size)
+        {
+            std::erase_if(nodes,
+                          [](const auto& n) { return n.second.expired(); });
+            sweep_size = std::max<size_t>(1024, nodes.size() * 2);
+        }
+        node->interned = true;
+        nodes.emplace(h, node);
+        return node;
+    }
+
+    // true if the caller holds the only reference to node, which is then
+    // out of the table, so nothing can get it back while it is taken apart
+    bool retire(const std::shared_ptr<symbolic_actual>& node)
+    {
+        if (!node->interned)
+        {
+            // only the table hands out nodes that nobody else holds
+            return node.use_count() == 1;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        if (node.use_count() != 1)
+        {
+            return false;
+        }
+        auto [first, last] = nodes.equal_range(node->hash);
+        for (auto it = first; it != last; it++)
+        {
+            if (!it->second.owner_before(node) &&
+                !node.owner_before(it->second))
+            {
+                nodes.erase(it);
+                break;
+            }
+        }
+        return true;
+    }
+
+  protected:
+    std::mutex lock;
+    std::unordered_multimap<size_t, std::weak_ptr<symbolic_actual>> nodes;
+    size_t sweep_size = 1024;
+};
+
+// intern the tree below root from the bottom up
+std::shared_ptr<symbolic_actual>
+    intern_tree(const std::shared_ptr<symbolic_actual>& root)
+{
+    if (root->interned)
+    {
+        return root;
+    }
+    auto pending_child =
+        [](const symbolic_operand& o) -> const symbolic_actual* {
+        if (auto s = std::get_if<symbolic>(&o); s && !(**s).interned)
+        {
+            return &(**s);
+        }
+        return nullptr;
+    };
+    std::unordered_map<const symbolic_actual*, std::shared_ptr<symbolic_actual>>
+        done{};
+    std::vector<std::tuple<const symbolic_actual*, bool>> work{
+        {root.get(), false}};
+    while (work.size())
+    {
+        auto [n, expanded] = work.back();
+        work.pop_back();
+        if (done.contains(n))
+        {
+            continue;
+        }
+        if (!expanded)
+        {
+            work.push_back({n, true});
+            for (const auto* o : {&n->left, &n->right})
+            {
+                if (auto c = pending_child(*o); c)
+                {
+                    work.push_back({c, false});
+                }
+            }
+            continue;
+        }
+        auto node = std::make_shared<symbolic_actual>(*n);
+        for (auto* o : {&node->left, &node->right})
+        {
+            if (auto c = pending_child(*o); c)
+            {
+                *o = symbolic{std::shared_ptr<symbolic_actual>{done.at(c)}};
+            }
+        }
+        done[n] = intern_table::get().insert(std::move(node));
+    }
+    return done.at(root.get());
 }
-symbolic::symbolic(const symbolic& o) :
-    ptr(std::make_shared<symbolic_actual>(*this, *o))
+
+} // namespace
+
+symbolic::symbolic() : ptr(std::make_shared<symbolic_actual>())
 {
 }
-// moves to improve performance
-symbolic::symbolic(symbolic&& o) : ptr(o.ptr)
+symbolic::symbolic(const symbolic& o) : ptr(o.ptr)
+{
+}
+symbolic::symbolic(symbolic&& o) : ptr(std::move(o.ptr))
 {
-    // eliminate the symbolic_actual from o
-    o.ptr.reset();
-    // set new symbolic to be creator of moved symbolic_actual
-    ptr->box = std::ref(*this);
 }
 symbolic::~symbolic()
 {
 }
-symbolic::symbolic(const mpx& o) :
-    ptr(std::make_shared<symbolic_actual>(*this, o))
+symbolic::symbolic(const mpx& o) : ptr(std::make_shared<symbolic_actual>(o))
 {
 }
 
 symbolic::symbolic(const std::string& o) :
-    ptr(std::make_shared<symbolic_actual>(*this, o))
+    ptr(std::make_shared<symbolic_actual>(o))
+{
+}
+
+symbolic::symbolic(std::shared_ptr<symbolic_actual>&& p) : ptr(std::move(p))
 {
 }
 
+std::shared_ptr<symbolic_actual> symbolic::release()
+{
+    return std::move(ptr);
+}
+
 symbolic& symbolic::operator=(const symbolic& o)
 {
-    ptr = std::make_shared<symbolic_actual>(*this, *o);
+    ptr = o.ptr;
     return *this;
 }
 symbolic& symbolic::operator=(symbolic&& o)
 {
-    ptr = o.ptr;
-    // eliminate the symbolic_actual from o
-    o.ptr.reset();
-    // set new symbolic to be creator of moved symbolic_actual
-    ptr->box = std::ref(*this);
+    ptr = std::move(o.ptr);
     return *this;
 }
-symbolic_actual& symbolic::operator*() const
+const symbolic_actual& symbolic::operator*() const
 {
     return *ptr;
 }
+symbolic_actual& symbolic::operator*()
+{
+    // copy on write: shared and interned nodes must not change
+    if (ptr->interned || ptr.use_count() > 1)
+    {
+        ptr = std::make_shared<symbolic_actual>(*ptr);
+    }
+    return *ptr;
+}
+
+symbolic symbolic::interned() const
+{
+    if (ptr->interned)
+    {
+        return *this;
+    }
+    return symbolic{intern_tree(ptr)};
+}
+
+bool symbolic::operator==(const symbolic& o) const
+{
+    return interned().ptr == o.interned().ptr;
+}
+
+/*
+ * Light canonicalization while building expressions, so ones that are
+ * built up in a loop do not grow without bound: exact constants are
+ * folded, identities (x+0, 1*x, x^1, x-x, ...) are dropped and a constant
+ * is folded into a + or * chain that already ends in a constant, so
+ * x+1+1+1 stays x+3. Float constants are left as they are; folding them
+ * here would fix their precision before the expression is evaluated.
+ */
+namespace
+{
+
+// the value of a constant leaf or operand
+const mpx* constant(const symbolic_operand& o);
+
+const mpx* constant(const symbolic& s)
+{
+    const symbolic_actual& n = *s;
+    if (n.fn_ptr != invalid_function)
+    {
+        return nullptr;
+    }
+    return constant(n.left);
+}
+
+const mpx* constant(const symbolic_operand& o)
+{
+    if (auto v = std::get_if<mpx>(&o); v)
+    {
+        return v;
+    }
+    if (auto s = std::get_if<symbolic>(&o); s)
+    {
+        return constant(*s);
+    }
+    return nullptr;
+}
+
+std::optional<mpq> exact_value(const mpx* v)
+{
+    if (!v)
+    {
+        return std::nullopt;
+    }
+    if (auto z = std::get_if<mpz>(v); z)
+    {
+        return mpq(*z, mpz{1});
+    }
+    if (auto q = std::get_if<mpq>(v); q)
+    {
+        return *q;
+    }
+    return std::nullopt;
+}
+
+bool is_exactly(const mpx* v, int n)
+{
+    auto q = exact_value(v);
+    return q && *q == mpq(mpz{n}, mpz{1});
+}
+
+symbolic constant_symbolic(const mpq& v)
+{
+    return symbolic{reduce_numeric(mpx{v})}.interned();
+}
+
+symbolic as_symbolic(const symbolic_operand& o)
+{
+    if (auto s = std::get_if<symbolic>(&o); s)
+    {
+        return *s;
+    }
+    if (auto v = std::get_if<mpx>(&o); v)
+    {
+        return symbolic{*v}.interned();
+    }
+    if (auto v = std::get_if<std::string>(&o); v)
+    {
+        return symbolic{*v}.interned();
+    }
+    return symbolic{}.interned();
+}
+
+std::optional<mpq> fold_exact(std::string_view op, const mpq& a, const mpq& b)
+{
+    if (op == "+")
+    {
+        return a + b;
+    }
+    if (op == "-")
+    {
+        return a - b;
+    }
+    if (op == "*")
+    {
+        return a * b;
+    }
+    if (op == "/" && b != mpq(mpz{0}, mpz{1}))
+    {
+        return a / b;
+    }
+    return std::nullopt;
+}
+
+symbolic make_infix(std::string_view op, const symbolic& a, const symbolic& b);
+
+std::optional<symbolic> simplify_infix(std::string_view op, const symbolic& a,
+                                       const symbolic& b)
+{
+    const mpx* ca = constant(a);
+    const mpx* cb = constant(b);
+    auto qa = exact_value(ca);
+    auto qb = exact_value(cb);
+    if (qa && qb)
+    {
+        if (auto r = fold_exact(op, *qa, *qb); r)
+        {
+            return constant_symbolic(*r);
+        }
+        return std::nullopt;
+    }
+    if (op == "+")
+    {
+        if (is_exactly(cb, 0))
+        {
+            return a;
+        }
+        if (is_exactly(ca, 0))
+        {
+            return b;
+        }
+    }
+    else if (op == "-")
+    {
+        if (is_exactly(cb, 0))
+        {
+            return a;
+        }
+        if (a == b)
+        {
+            return constant_symbolic(mpq(mpz{0}, mpz{1}));
+        }
+    }
+    else if (op == "*")
+    {
+        if (is_exactly(ca, 0) || is_exactly(cb, 0))
+        {
+            return constant_symbolic(mpq(mpz{0}, mpz{1}));
+        }
+        if (is_exactly(cb, 1))
+        {
+            return a;
+        }
+        if (is_exactly(ca, 1))
+        {
+            return b;
+        }
+    }
+    else if (op == "/")
+    {
+        if (is_exactly(cb, 1))
+        {
+            return a;
+        }
+    }
+    if ((op == "+" || op == "*") && (qa || qb))
+    {
+        // (y op c1) op c2 -> y op (c1 op c2), in either order
+        const symbolic& other = qa ? b : a;
+        const mpq& c = qa ? *qa : *qb;
+        const symbolic_actual& n = *other;
+        if (n.fn_style != symbolic_op::infix ||
+            n.fn_ptr != fn_get_fn_ptr_by_name(op))
+        {
+            return std::nullopt;
+        }
+        if (auto c2 = exact_value(constant(n.right)); c2)
+        {
+            return make_infix(op, as_symbolic(n.left),
+                              constant_symbolic(*fold_exact(op, *c2, c)));
+        }
+        if (auto c2 = exact_value(constant(n.left)); c2)
+        {
+            return make_infix(op, constant_symbolic(*fold_exact(op, *c2, c)),
+                              as_symbolic(n.right));
+        }
+    }
+    return std::nullopt;
+}
+
+// build an infix node from two finished expressions
+symbolic make_infix(std::string_view op, const symbolic& a, const symbolic& b)
+{
+    if (auto s = simplify_infix(op, a, b); s)
+    {
+        lg::verbose("symbolic '{}' {} '{}' simplified to {}\n", a, op, b, *s);
+        return *s;
+    }
+    symbolic s{};
+    symbolic_actual& node = *s;
+    node.fn_ptr = fn_get_fn_ptr_by_name(op);
+    node.fn_style = symbolic_op::infix;
+    node.left = a;
+    node.right = b;
+    return s.interned();
+}
+
+} // namespace
 
 symbolic symbolic::operator+(const symbolic& o) const
 {
     lg::verbose("symbolic '{}' + '{}'\n", *this, o);
-    return *ptr + *o;
+    return make_infix("+", *this, o);
 }
 symbolic symbolic::operator-(const symbolic& o) const
 {
     lg::verbose("symbolic '{}' - '{}'\n", *this, o);
-    return *ptr - *o;
+    return make_infix("-", *this, o);
 }
 symbolic symbolic::operator*(const symbolic& o) const
 {
     lg::verbose("symbolic '{}' * '{}'\n", *this, o);
-    return *ptr * *o;
+    return make_infix("*", *this, o);
 }
 symbolic symbolic::operator/(const symbolic& o) const
 {
     lg::verbose("symbolic '{}' / '{}'\n", *this, o);
-    return *ptr / *o;
+    return make_infix("/", *this, o);
 }
 symbolic symbolic::operator%(const symbolic& o) const
 {
     lg::verbose("symbolic '{}' % '{}'\n", *this, o);
-    return *ptr / *o;
+    return make_infix("%", *this, o);
 }
 
 void symbolic::eval(Calculator& calc) const
@@ -110,120 +564,591 @@ void symbolic::eval(Calculator& calc) const
     ptr->eval(calc);
 }
 
-symbolic_actual::symbolic_actual(symbolic& creator) :
-    box(std::ref(creator)), fn_ptr(invalid_function),
-    fn_style(symbolic_op::none)
+std::optional<symbolic_double_fn>
+    symbolic::compile_double(Calculator& calc, std::string_view var) const
 {
+    return ptr->compile_double(calc, var);
 }
 
-symbolic_actual::symbolic_actual(symbolic& creator, const symbolic_actual& o) :
-    box(std::ref(creator)), fn_ptr(o.fn_ptr), fn_style(o.fn_style)
+symbolic_actual::symbolic_actual() :
+    fn_ptr(invalid_function), fn_style(symbolic_op::none), hash(0),
+    interned(false)
+{
+}
+
+// operands are shared; the copy is not interned and has no compiled form
+symbolic_actual::symbolic_actual(const symbolic_actual& o) :
+    fn_ptr(o.fn_ptr), fn_style(o.fn_style), left(o.left), right(o.right),
+    hash(0), interned(false)
 {
-    auto get_arg = [](const auto& a) -> symbolic_operand {
-        if constexpr (same_type_v<decltype(a), std::string> ||
-                      same_type_v<decltype(a), mpx>)
-        {
-            lg::verbose("arg is variable or numeric\n");
-            return a;
-        }
-        else if constexpr (same_type_v<decltype(a), symbolic>)
-        {
-            lg::verbose("arg is symbolic\n");
-            return symbolic{a};
-        }
-        else
-        {
-            lg::verbose("arg is monostate\n");
-            return std::monostate();
-        }
-    };
-    left = std::visit(get_arg, o.left);
-    right = std::visit(get_arg, o.right);
 }
 
+// releasing a long chain would nest one destructor per node, so the
+// children that die with this node are taken apart here in a loop
 symbolic_actual::~symbolic_actual()
 {
+    std::vector<std::shared_ptr<symbolic_actual>> dying{};
+    auto take = [&dying](symbolic_operand& o) {
+        if (auto s = std::get_if<symbolic>(&o); s)
+        {
+            if (auto p = s->release(); p)
+            {
+                dying.push_back(std::move(p));
+            }
+        }
+    };
+    take(left);
+    take(right);
+    while (dying.size())
+    {
+        auto n = std::move(dying.back());
+        dying.pop_back();
+        // a node that is still shared only loses this reference
+        if (intern_table::get().retire(n))
+        {
+            take(n->left);
+            take(n->right);
+        }
+        // n has no children left to release, so its destructor is shallow
+    }
 }
 
-symbolic_actual::symbolic_actual(symbolic& creator, const mpx& o) :
-    box(std::ref(creator)), fn_ptr(invalid_function),
-    fn_style(symbolic_op::none), left(o)
+symbolic_actual::symbolic_actual(const mpx& o) :
+    fn_ptr(invalid_function), fn_style(symbolic_op::none), left(o), hash(0),
+    interned(false)
 {
 }
 
-symbolic_actual::symbolic_actual(symbolic& creator, const std::string& o) :
-    box(std::ref(creator)), fn_ptr(invalid_function),
-    fn_style(symbolic_op::none), left(o)
+symbolic_actual::symbolic_actual(const std::string& o) :
+    fn_ptr(invalid_function), fn_style(symbolic_op::none), left(o), hash(0),
+    interned(false)
 {
 }
 
-void symbolic_actual::eval(Calculator& calc) const
+/*
+ * A symbolic compiled to postfix order: constants are converted once,
+ * each distinct variable gets a slot that is looked up once per
+ * evaluation and the functions are already resolved. A subexpression
+ * that is shared in the DAG is computed once; its result is kept in a
+ * slot and pushed again where it is used next. It runs on its own stack
+ * so that only the result lands on the calculator stack.
+ */
+struct symbolic_tape
 {
-    auto push = [&calc](numeric&& v) {
-        stack_entry e;
-        e.base = calc.config.base;
-        e.precision = calc.config.precision;
-        e.fixed_bits = calc.config.fixed_bits;
-        e.is_signed = calc.config.is_signed;
-        e.value(std::move(v));
-        calc.stack.push_front(std::move(e));
+    struct variable
+    {
+        size_t slot;
+    };
+    struct keep
+    {
+        size_t slot;
+    };
+    struct reuse
+    {
+        size_t slot;
+    };
+    struct call
+    {
+        CalcFunction::ptr fn;
+        symbolic_op style;
     };
-    // TODO: how this gonna work, dumbass?
-    //
-    // 1. turn the tree into a program and execute that
-    // 2. add a 'symbolic' mode to functions that can take operate on symbolics
-    // 3. push stuff onto the stack, perform the op, and pop an item back off
-    //
-    // depth first evaluation of symbolic tree
-    if (!std::get_if<std::monostate>(&left))
+    using step = std::variant<numeric, variable, call, keep, reuse>;
+
+    std::vector<step> steps;
+    std::vector<std::string> variables;
+    size_t shared_count = 0;
+
+    explicit symbolic_tape(const symbolic_actual& root)
     {
-        if (auto s = std::get_if<symbolic>(&left); s)
+        // same order as a depth first walk: left, right, then the op;
+        // an explicit work stack keeps deep trees off the native stack
+        struct work_item
+        {
+            const symbolic_actual* node;
+            const symbolic_operand* leaf;
+            bool expanded;
+        };
+        auto uses = count_uses(root);
+        // slots for shared nodes, filled in when they are first computed
+        std::unordered_map<const symbolic_actual*, size_t> shared{};
+        std::vector<work_item> work{{&root, nullptr, false}};
+        auto add_operand = [&work](const symbolic_operand& o) {
+            if (auto s = std::get_if<symbolic>(&o); s)
+            {
+                work.push_back({&(**s), nullptr, false});
+            }
+            else if (!std::get_if<std::monostate>(&o))
+            {
+                work.push_back({nullptr, &o, false});
+            }
+        };
+        while (work.size())
         {
-            s->eval(calc);
+            work_item w = work.back();
+            work.pop_back();
+            if (w.leaf)
+            {
+                add_leaf(*w.leaf);
+            }
+            else if (w.expanded)
+            {
+                if (w.node->fn_ptr != invalid_function)
+                {
+                    steps.emplace_back(
+                        call{w.node->fn_ptr, w.node->fn_style});
+                    if (uses[w.node] > 1)
+                    {
+                        shared[w.node] = shared_count;
+                        steps.emplace_back(keep{shared_count++});
+                    }
+                }
+            }
+            else if (auto s = shared.find(w.node); s != shared.end())
+            {
+                steps.emplace_back(reuse{s->second});
+            }
+            else
+            {
+                // left is on top so it runs first
+                work.push_back({w.node, nullptr, true});
+                add_operand(w.node->right);
+                add_operand(w.node->left);
+            }
         }
-        else if (auto s = std::get_if<mpx>(&left); s)
+    }
+
+    // how many times each function node is referenced in the DAG
+    static std::unordered_map<const symbolic_actual*, size_t>
+        count_uses(const symbolic_actual& root)
+    {
+        std::unordered_map<const symbolic_actual*, size_t> uses{};
+        std::vector<const symbolic_actual*> work{&root};
+        while (work.size())
         {
-            std::visit(push, *s);
+            const symbolic_actual* n = work.back();
+            work.pop_back();
+            if (uses[n]++)
+            {
+                // already walked below here
+                continue;
+            }
+            for (const auto* o : {&n->left, &n->right})
+            {
+                if (auto s = std::get_if<symbolic>(o); s)
+                {
+                    work.push_back(&(**s));
+                }
+            }
+        }
+        return uses;
+    }
+
+    void add_leaf(const symbolic_operand& o)
+    {
+        if (auto v = std::get_if<mpx>(&o); v)
+        {
+            steps.emplace_back(numeric{variant_cast(*v)});
         }
-        else if (auto s = std::get_if<std::string>(&left); s)
+        else if (auto name = std::get_if<std::string>(&o); name)
         {
-            if (auto v = calc.get_var(*s); v)
+            auto it = std::find(variables.begin(), variables.end(), *name);
+            size_t slot = it - variables.begin();
+            if (it == variables.end())
             {
-                push(std::move(*v));
+                variables.push_back(*name);
+            }
+            steps.emplace_back(variable{slot});
+        }
+    }
+
+    void run(Calculator& calc) const
+    {
+        // unknown variables stay symbolic
+        std::vector<numeric> values{};
+        values.reserve(variables.size());
+        for (const auto& name : variables)
+        {
+            if (auto v = calc.get_var(name); v)
+            {
+                values.emplace_back(std::move(*v));
             }
             else
             {
-                push(symbolic{*s});
+                values.emplace_back(symbolic{name});
             }
         }
+        std::vector<stack_entry> kept(shared_count);
+
+        Calculator::Stack results{};
+        std::swap(results, calc.stack);
+        struct restore_stack
+        {
+            Calculator::Stack& a;
+            Calculator::Stack& b;
+            ~restore_stack()
+            {
+                std::swap(a, b);
+            }
+        } restore{results, calc.stack};
+
+        auto push = [&calc](const numeric& v) {
+            stack_entry e;
+            e.base = calc.config.base;
+            e.precision = calc.config.precision;
+            e.fixed_bits = calc.config.fixed_bits;
+            e.is_signed = calc.config.is_signed;
+            e.value(v);
+            calc.stack.push_front(std::move(e));
+        };
+        for (const auto& s : steps)
+        {
+            if (auto v = std::get_if<numeric>(&s); v)
+            {
+                push(*v);
+            }
+            else if (auto var = std::get_if<variable>(&s); var)
+            {
+                push(values[var->slot]);
+            }
+            else if (auto k = std::get_if<keep>(&s); k)
+            {
+                if (calc.stack.empty())
+                {
+                    throw std::runtime_error(
+                        "symbolic evaluation left nothing to keep");
+                }
+                kept[k->slot] = calc.stack.front();
+            }
+            else if (auto r = std::get_if<reuse>(&s); r)
+            {
+                calc.stack.push_front(kept[r->slot]);
+            }
+            else
+            {
+                // the same checks as Calculator::run_one, but a failure
+                // stops the whole evaluation
+                const auto& fn = std::get<call>(s).fn;
+                size_t min_items = std::abs(fn->num_args());
+                if (min_items > calc.stack.size())
+                {
+                    throw std::runtime_error(std::format(
+                        "{} requires at least {} items on the stack; only {} "
+                        "items are currently present",
+                        fn_get_name(fn), min_items, calc.stack.size()));
+                }
+                if (!fn->op(calc))
+                {
+                    throw std::runtime_error(std::format(
+                        "symbolic evaluation failed in '{}'", fn_get_name(fn)));
+                }
+            }
+        }
+        // the results go on the caller's stack in order
+        while (calc.stack.size())
+        {
+            results.push_front(std::move(calc.stack.back()));
+            calc.stack.pop_back();
+        }
     }
-    if (!std::get_if<std::monostate>(&right))
+};
+
+std::shared_ptr<const symbolic_tape> symbolic_actual::compiled() const
+{
+    auto t = tape.load();
+    if (!t)
     {
-        if (auto s = std::get_if<symbolic>(&right); s)
+        // two threads may both compile it; either result will do
+        t = std::make_shared<const symbolic_tape>(*this);
+        lg::debug("compiled symbolic to {} steps\n", t->steps.size());
+        tape.store(t);
+    }
+    return t;
+}
+
+void symbolic_actual::eval(Calculator& calc) const
+{
+    compiled()->run(calc);
+}
+
+namespace
+{
+
+using double_op = symbolic_double_fn::opcode;
+
+std::optional<double> real_as_double(const numeric& v)
+{
+    return std::visit(
+        [](const auto& x) -> std::optional<double> {
+            using x_type = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<x_type, mpz> ||
+                          std::is_same_v<x_type, mpq> ||
+                          std::is_same_v<x_type, mpf>)
+            {
+                return static_cast<double>(static_cast<mpf>(x));
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        },
+        v);
+}
+
+std::optional<double_op> double_function(const CalcFunction::ptr& fn,
+                                         symbolic_op style, bool radians)
+{
+    static const auto ops = std::to_array<std::tuple<std::string_view, int,
+                                                     double_op>>({
+        // name, arguments, op
+        {"+", 2, double_op::add},
+        {"-", 2, double_op::sub},
+        {"*", 2, double_op::mul},
+        {"/", 2, double_op::div},
+        {"^", 2, double_op::pow},
+        {"-", 1, double_op::neg},
+        {"!", 1, double_op::fact},
+        {"abs", 1, double_op::abs},
+        {"ceil", 1, double_op::ceil},
+        {"floor", 1, double_op::floor},
+        {"round", 1, double_op::round},
+        {"sqrt", 1, double_op::sqrt},
+        {"ln", 1, double_op::ln},
+        {"log", 1, double_op::log},
+        {"sinh", 1, double_op::sinh},
+        {"cosh", 1, double_op::cosh},
+        {"tanh", 1, double_op::tanh},
+        {"asinh", 1, double_op::asinh},
+        {"acosh", 1, double_op::acosh},
+        {"atanh", 1, double_op::atanh},
+        {"sin", 1, double_op::sin},
+        {"cos", 1, double_op::cos},
+        {"tan", 1, double_op::tan},
+        {"asin", 1, double_op::asin},
+        {"acos", 1, double_op::acos},
+        {"atan", 1, double_op::atan},
+    });
+    int args = style == symbolic_op::infix ? 2 : 1;
+    std::string_view name = fn_get_name(fn);
+    for (const auto& [n, a, op] : ops)
+    {
+        if (n == name && a == args)
         {
-            s->eval(calc);
+            if (op >= double_op::sin && !radians)
+            {
+                // the angle mode scaling is left to the full path
+                return std::nullopt;
+            }
+            return op;
         }
-        else if (auto s = std::get_if<mpx>(&right); s)
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+double symbolic_double_fn::operator()(double x) const
+{
+    static thread_local std::vector<double> stack{};
+    static thread_local std::vector<double> kept{};
+    stack.clear();
+    kept.resize(keep_count);
+    auto unary = [](double& a, auto fn) { a = fn(a); };
+    for (const auto& s : steps)
+    {
+        switch (s.op)
         {
-            std::visit(push, *s);
+            case opcode::value:
+                stack.push_back(s.value);
+                continue;
+            case opcode::input:
+                stack.push_back(x);
+                continue;
+            case opcode::keep:
+                kept[s.slot] = stack.back();
+                continue;
+            case opcode::reuse:
+                stack.push_back(kept[s.slot]);
+                continue;
+            default:
+                break;
         }
-        else if (auto s = std::get_if<std::string>(&right); s)
+        if (s.op <= opcode::pow)
         {
-            if (auto v = calc.get_var(*s); v)
+            double b = stack.back();
+            stack.pop_back();
+            double& a = stack.back();
+            switch (s.op)
             {
-                push(std::move(*v));
+                case opcode::add:
+                    a += b;
+                    break;
+                case opcode::sub:
+                    a -= b;
+                    break;
+                case opcode::mul:
+                    a *= b;
+                    break;
+                case opcode::div:
+                    a /= b;
+                    break;
+                default:
+                    a = std::pow(a, b);
+                    break;
             }
-            else
+            continue;
+        }
+        double& a = stack.back();
+        switch (s.op)
+        {
+            case opcode::neg:
+                a = -a;
+                break;
+            case opcode::fact:
+                a = std::tgamma(a + 1.0);
+                break;
+            case opcode::abs:
+                unary(a, [](double v) { return std::fabs(v); });
+                break;
+            case opcode::ceil:
+                unary(a, [](double v) { return std::ceil(v); });
+                break;
+            case opcode::floor:
+                unary(a, [](double v) { return std::floor(v); });
+                break;
+            case opcode::round:
+                unary(a, [](double v) { return std::round(v); });
+                break;
+            case opcode::sqrt:
+                unary(a, [](double v) { return std::sqrt(v); });
+                break;
+            case opcode::ln:
+                unary(a, [](double v) { return std::log(v); });
+                break;
+            case opcode::log:
+                unary(a, [](double v) { return std::log10(v); });
+                break;
+            case opcode::sinh:
+                unary(a, [](double v) { return std::sinh(v); });
+                break;
+            case opcode::cosh:
+                unary(a, [](double v) { return std::cosh(v); });
+                break;
+            case opcode::tanh:
+                unary(a, [](double v) { return std::tanh(v); });
+                break;
+            case opcode::asinh:
+                unary(a, [](double v) { return std::asinh(v); });
+                break;
+            case opcode::acosh:
+                unary(a, [](double v) { return std::acosh(v); });
+                break;
+            case opcode::atanh:
+                unary(a, [](double v) { return std::atanh(v); });
+                break;
+            case opcode::sin:
+                unary(a, [](double v) { return std::sin(v); });
+                break;
+            case opcode::cos:
+                unary(a, [](double v) { return std::cos(v); });
+                break;
+            case opcode::tan:
+                unary(a, [](double v) { return std::tan(v); });
+                break;
+            case opcode::asin:
+                unary(a, [](double v) { return std::asin(v); });
+                break;
+            case opcode::acos:
+                unary(a, [](double v) { return std::acos(v); });
+                break;
+            case opcode::atan:
+                unary(a, [](double v) { return std::atan(v); });
+                break;
+            default:
+                break;
+        }
+    }
+    return stack.back();
+}
+
+std::optional<symbolic_double_fn>
+    symbolic_actual::compile_double(Calculator& calc,
+                                    std::string_view var) const
+{
+    auto tape = compiled();
+    symbolic_double_fn fn{};
+    fn.keep_count = tape->shared_count;
+    bool radians =
+        calc.config.angle_mode == Calculator::e_angle_mode::radians;
+    // the other variables are constant for the whole run
+    std::vector<std::optional<double>> values{};
+    for (const auto& name : tape->variables)
+    {
+        if (name == var)
+        {
+            values.emplace_back(std::nullopt);
+        }
+        else if (auto v = calc.get_var(name); v)
+        {
+            auto d = real_as_double(*v);
+            if (!d)
+            {
+                return std::nullopt;
+            }
+            values.emplace_back(d);
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+    size_t depth = 0;
+    for (const auto& s : tape->steps)
+    {
+        using op = symbolic_double_fn::opcode;
+        if (auto v = std::get_if<numeric>(&s); v)
+        {
+            auto d = real_as_double(*v);
+            if (!d)
+            {
+                return std::nullopt;
+            }
+            fn.steps.push_back({op::value, *d, 0});
+            depth++;
+        }
+        else if (auto v = std::get_if<symbolic_tape::variable>(&s); v)
+        {
+            auto& d = values[v->slot];
+            fn.steps.push_back(d ? symbolic_double_fn::step{op::value, *d, 0}
+                                 : symbolic_double_fn::step{op::input, 0, 0});
+            depth++;
+        }
+        else if (auto k = std::get_if<symbolic_tape::keep>(&s); k)
+        {
+            fn.steps.push_back({op::keep, 0, k->slot});
+        }
+        else if (auto r = std::get_if<symbolic_tape::reuse>(&s); r)
+        {
+            fn.steps.push_back({op::reuse, 0, r->slot});
+            depth++;
+        }
+        else
+        {
+            const auto& c = std::get<symbolic_tape::call>(s);
+            auto o = double_function(c.fn, c.style, radians);
+            size_t args = (o && *o <= op::pow) ? 2 : 1;
+            if (!o || depth < args)
             {
-                push(symbolic{*s});
+                return std::nullopt;
             }
+            fn.steps.push_back({*o, 0, 0});
+            depth -= args - 1;
         }
     }
-    if (fn_ptr != invalid_function)
+    if (depth != 1)
     {
-        fn_ptr->op(calc);
-        // the Eval function pops the final item back off the stack
+        return std::nullopt;
     }
+    return fn;
 }
 
 fn_prio symbolic_actual::prio() const
@@ -289,66 +1214,6 @@ fn_prio symbolic_actual::prio() const
         "unable to classify function priority for symbolic");
 }
 
-symbolic symbolic_actual::operator+(const symbolic_actual& o) const
-{
-    symbolic s{};
-    symbolic_actual& sum = *s;
-    sum.fn_ptr = fn_get_fn_ptr_by_name("+");
-    sum.fn_style = symbolic_op::infix;
-    sum.left = box.get();
-    sum.right = o.box.get();
-    lg::verbose("symbolic addition: {}\n", s);
-    return s;
-}
-
-symbolic symbolic_actual::operator-(const symbolic_actual& o) const
-{
-    symbolic d{};
-    symbolic_actual& diff = *d;
-    diff.fn_ptr = fn_get_fn_ptr_by_name("-");
-    diff.fn_style = symbolic_op::infix;
-    diff.left = box.get();
-    diff.right = o.box.get();
-    lg::verbose("symbolic subtraction: {}\n", d);
-    return d;
-}
-
-symbolic symbolic_actual::operator*(const symbolic_actual& o) const
-{
-    symbolic p{};
-    symbolic_actual& prod = *p;
-    prod.fn_ptr = fn_get_fn_ptr_by_name("*");
-    prod.fn_style = symbolic_op::infix;
-    prod.left = box.get();
-    prod.right = o.box.get();
-    lg::verbose("symbolic multiplication: {}\n", p);
-    return p;
-}
-
-symbolic symbolic_actual::operator/(const symbolic_actual& o) const
-{
-    symbolic d{};
-    symbolic_actual& div = *d;
-    div.fn_ptr = fn_get_fn_ptr_by_name("/");
-    div.fn_style = symbolic_op::infix;
-    div.left = box.get();
-    div.right = o.box.get();
-    lg::verbose("symbolic division: {}\n", d);
-    return d;
-}
-
-symbolic symbolic_actual::operator%(const symbolic_actual& o) const
-{
-    symbolic d{};
-    symbolic_actual& div = *d;
-    div.fn_ptr = fn_get_fn_ptr_by_name("%");
-    div.fn_style = symbolic_op::infix;
-    div.left = box.get();
-    div.right = o.box.get();
-    lg::verbose("symbolic divmod: {}\n", d);
-    return d;
-}
-
 // functions on symbolics
 symbolic floor(const symbolic& v)
 {
@@ -358,7 +1223,7 @@ symbolic floor(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic floor: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic ceil(const symbolic& v)
@@ -369,7 +1234,7 @@ symbolic ceil(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic ceil: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic round(const symbolic& v)
@@ -380,7 +1245,7 @@ symbolic round(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic round: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic lcm(const symbolic& a, const symbolic& b)
@@ -392,7 +1257,7 @@ symbolic lcm(const symbolic& a, const symbolic& b)
     fn.left = a;
     fn.right = b;
     lg::verbose("symbolic lcm: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic lcm(const mpz& a, const symbolic& b)
@@ -414,7 +1279,7 @@ symbolic gcd(const symbolic& a, const symbolic& b)
     fn.left = a;
     fn.right = b;
     lg::verbose("symbolic gcd: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic gcd(const mpz& a, const symbolic& b)
@@ -429,6 +1294,15 @@ symbolic gcd(const symbolic& a, const mpz& b)
 
 symbolic pow(const symbolic& a, const symbolic& b)
 {
+    const mpx* cb = constant(b);
+    if (is_exactly(cb, 1))
+    {
+        return a;
+    }
+    if (is_exactly(cb, 0) || is_exactly(constant(a), 1))
+    {
+        return constant_symbolic(mpq(mpz{1}, mpz{1}));
+    }
     symbolic f{};
     symbolic_actual& fn = *f;
     fn.fn_ptr = fn_get_fn_ptr_by_name("^");
@@ -436,7 +1310,7 @@ symbolic pow(const symbolic& a, const symbolic& b)
     fn.left = a;
     fn.right = b;
     lg::verbose("symbolic pow: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic pow(const mpx& a, const symbolic& b)
@@ -457,7 +1331,7 @@ symbolic exp(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic exp: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic powul(const symbolic& a, const symbolic& b)
@@ -473,7 +1347,7 @@ symbolic factorial(const symbolic& v)
     fn.fn_style = symbolic_op::postfix;
     fn.left = v;
     lg::verbose("symbolic factorial: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic tgamma(const symbolic& v)
@@ -484,7 +1358,7 @@ symbolic tgamma(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic gamma: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic zeta(const symbolic& v)
@@ -495,7 +1369,7 @@ symbolic zeta(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic zeta: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic abs(const symbolic& v)
@@ -506,7 +1380,7 @@ symbolic abs(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic abs: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic log(const symbolic& v)
@@ -517,7 +1391,7 @@ symbolic log(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic log: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic ln(const symbolic& v)
@@ -528,7 +1402,7 @@ symbolic ln(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic ln: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic sqrt(const symbolic& v)
@@ -539,7 +1413,7 @@ symbolic sqrt(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic sqrt: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic sin(const symbolic& v)
@@ -550,7 +1424,7 @@ symbolic sin(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic sin: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic cos(const symbolic& v)
@@ -561,7 +1435,7 @@ symbolic cos(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic cos: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic tan(const symbolic& v)
@@ -572,7 +1446,7 @@ symbolic tan(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic tan: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic asin(const symbolic& v)
@@ -583,7 +1457,7 @@ symbolic asin(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic asin: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic acos(const symbolic& v)
@@ -594,7 +1468,7 @@ symbolic acos(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic acos: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic atan(const symbolic& v)
@@ -605,7 +1479,7 @@ symbolic atan(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic atan: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic sinh(const symbolic& v)
@@ -616,7 +1490,7 @@ symbolic sinh(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic sinh: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic cosh(const symbolic& v)
@@ -627,7 +1501,7 @@ symbolic cosh(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic cosh: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic tanh(const symbolic& v)
@@ -638,7 +1512,7 @@ symbolic tanh(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic tanh: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic asinh(const symbolic& v)
@@ -649,7 +1523,7 @@ symbolic asinh(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic asinh: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic acosh(const symbolic& v)
@@ -660,7 +1534,7 @@ symbolic acosh(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic acosh: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 symbolic atanh(const symbolic& v)
@@ -671,7 +1545,7 @@ symbolic atanh(const symbolic& v)
     fn.fn_style = symbolic_op::paren;
     fn.left = v;
     lg::verbose("symbolic atanh: {}\n", f);
-    return f;
+    return f.interned();
 }
 
 } // namespace smrty
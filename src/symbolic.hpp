@@ -6,8 +6,12 @@ SPDX-License-Identifier: BSD-3-Clause
 
 #pragma once
 
+#include <atomic>
 #include <format>
 #include <function_library.hpp>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <regex>
 #include <std_container_format.hpp>
 #include <string>
@@ -50,6 +54,69 @@ enum class symbolic_op
 
 class Calculator;
 struct symbolic_actual;
+struct symbolic_tape;
+
+/*
+ * An expression in one variable compiled for hardware doubles, used to
+ * evaluate it at many points when the precision is low enough that the
+ * full numeric types are not needed.
+ */
+struct symbolic_double_fn
+{
+    // binary ops come first, then the unary ones; the circular trig
+    // functions are last because they depend on the angle mode
+    enum class opcode
+    {
+        value,
+        input,
+        keep,
+        reuse,
+        add,
+        sub,
+        mul,
+        div,
+        pow,
+        neg,
+        fact,
+        abs,
+        ceil,
+        floor,
+        round,
+        sqrt,
+        ln,
+        log,
+        sinh,
+        cosh,
+        tanh,
+        asinh,
+        acosh,
+        atanh,
+        sin,
+        cos,
+        tan,
+        asin,
+        acos,
+        atan,
+    };
+    struct step
+    {
+        opcode op;
+        double value;
+        size_t slot;
+    };
+
+    double operator()(double x) const;
+
+    std::vector<step> steps;
+    size_t keep_count = 0;
+};
+/*
+ * symbolic nodes are shared between copies. Finished expressions are
+ * interned: structurally identical subtrees are the same node, so a
+ * repeated subexpression is only stored (and evaluated) once and equal
+ * expressions compare by pointer. Changing a node through the non-const
+ * operator* makes a private copy of it first.
+ */
 class symbolic
 {
   public:
@@ -63,11 +130,13 @@ class symbolic
     explicit symbolic(const T& o) : symbolic(mpx{o})
     {
     }
+    explicit symbolic(std::shared_ptr<symbolic_actual>&& p);
     ~symbolic();
 
     symbolic& operator=(const symbolic& o);
     symbolic& operator=(symbolic&& o);
-    symbolic_actual& operator*() const;
+    const symbolic_actual& operator*() const;
+    symbolic_actual& operator*();
 
     symbolic operator+(const symbolic& o) const;
     symbolic operator-(const symbolic& o) const;
@@ -75,7 +144,20 @@ class symbolic
     symbolic operator/(const symbolic& o) const;
     symbolic operator%(const symbolic& o) const;
 
+    bool operator==(const symbolic& o) const;
+
+    // the shared, interned version of this expression
+    symbolic interned() const;
+
+    // the node, taken out of this symbolic, which is left empty; used to
+    // take deep trees apart without recursing
+    std::shared_ptr<symbolic_actual> release();
+
     void eval(Calculator&) const;
+    // returns nothing if the expression uses anything a double cannot
+    // do or a variable other than var that is not a real number
+    std::optional<symbolic_double_fn> compile_double(Calculator&,
+                                                     std::string_view var) const;
 
   protected:
     std::shared_ptr<symbolic_actual> ptr;
@@ -96,26 +178,32 @@ enum class fn_prio
 
 struct symbolic_actual
 {
-    explicit symbolic_actual(symbolic& creator);
-    symbolic_actual(symbolic& creator, const symbolic_actual& o);
-    symbolic_actual(symbolic& creator, const mpx& o);
-    symbolic_actual(symbolic& creator, const std::string& o);
+    symbolic_actual();
+    symbolic_actual(const symbolic_actual& o);
+    explicit symbolic_actual(const mpx& o);
+    explicit symbolic_actual(const std::string& o);
     ~symbolic_actual();
 
-    symbolic operator+(const symbolic_actual& o) const;
-    symbolic operator-(const symbolic_actual& o) const;
-    symbolic operator*(const symbolic_actual& o) const;
-    symbolic operator/(const symbolic_actual& o) const;
-    symbolic operator%(const symbolic_actual& o) const;
-
     void eval(Calculator&) const;
+    std::optional<symbolic_double_fn> compile_double(Calculator&,
+                                                     std::string_view var) const;
     fn_prio prio() const;
 
-    std::reference_wrapper<symbolic> box;
     CalcFunction::ptr fn_ptr;
     symbolic_op fn_style;
     symbolic_operand left;
     symbolic_operand right;
+
+    // set once the node is in the intern table; it must not change after
+    size_t hash;
+    bool interned;
+
+  protected:
+    // postfix form of this expression, built the first time it is
+    // evaluated and shared by everything that interned to this node
+    std::shared_ptr<const symbolic_tape> compiled() const;
+
+    mutable std::atomic<std::shared_ptr<const symbolic_tape>> tape;
 };
 
 symbolic floor(const symbolic& v);
@@ -205,87 +293,104 @@ struct std::formatter<smrty::symbolic_actual>
     auto format(const smrty::symbolic_actual& sym, FormatContext& ctx) const
         -> decltype(ctx.out())
     {
+        // expressions can be nested far deeper than the native stack
+        // allows, so the tree is walked with an explicit stack of pieces
+        // that are either text or a node that is still to be written
+        using piece = std::variant<std::string, const smrty::symbolic_actual*>;
+        std::vector<piece> work{&sym};
         auto out = ctx.out();
-        // mpx or symbolic single operand
-        if (sym.fn_ptr == smrty::invalid_function)
+        while (work.size())
         {
-            if (sym.fn_style == smrty::symbolic_op::paren)
+            piece p = std::move(work.back());
+            work.pop_back();
+            if (auto text = std::get_if<std::string>(&p); text)
             {
-                // just lefty
-                out = std::format_to(out, "{}", sym.left);
+                out = std::format_to(out, "{}", *text);
+                continue;
             }
-            else if (auto v = std::get_if<std::string>(&sym.left); v)
+            const smrty::symbolic_actual& n =
+                *std::get<const smrty::symbolic_actual*>(p);
+            // the pieces of n in order
+            std::vector<piece> parts{};
+            auto operand = [&parts](const smrty::symbolic_operand& o) {
+                if (auto s = std::get_if<smrty::symbolic>(&o); s)
+                {
+                    parts.emplace_back(&(**s));
+                }
+                else if (auto v = std::get_if<std::string>(&o); v)
+                {
+                    parts.emplace_back(*v);
+                }
+                else if (auto v = std::get_if<smrty::mpx>(&o); v)
+                {
+                    parts.emplace_back(std::format("{}", *v));
+                }
+            };
+            auto name = [&parts, &n]() {
+                parts.emplace_back(std::string{fn_get_name(n.fn_ptr)});
+            };
+            if (n.fn_ptr == smrty::invalid_function)
             {
-                // variable
-                out = std::format_to(out, "{}", sym.left);
+                // a number, a variable or a parenthesized expression
+                operand(n.left);
             }
-            else if (auto v = std::get_if<mpx>(&sym.left); v)
-            {
-                out = std::format_to(out, "{}", sym.left);
-            }
-            return out;
-        }
-        // multi-part op
-        if (sym.fn_style == smrty::symbolic_op::infix)
-        {
-            // check for adding explicit parenthesis
-            // left side
-            if (auto l = std::get_if<smrty::symbolic>(&(sym.left));
-                l && (*(*l)).fn_ptr != smrty::invalid_function &&
-                (*(*l)).prio() < sym.prio())
+            else if (n.fn_style == smrty::symbolic_op::infix)
             {
-                out = std::format_to(out, "({})", *l);
+                // add explicit parentheses around lower priority sides
+                auto side = [&](const smrty::symbolic_operand& o) {
+                    auto s = std::get_if<smrty::symbolic>(&o);
+                    if (s && (**s).fn_ptr != smrty::invalid_function &&
+                        (**s).prio() < n.prio())
+                    {
+                        parts.emplace_back(std::string{"("});
+                        operand(o);
+                        parts.emplace_back(std::string{")"});
+                    }
+                    else
+                    {
+                        operand(o);
+                    }
+                };
+                side(n.left);
+                name();
+                side(n.right);
             }
-            else
+            else if (n.fn_style == smrty::symbolic_op::prefix)
             {
-                out = std::format_to(out, "{}", sym.left);
+                name();
+                operand(n.left);
             }
-            // op
-            out = std::format_to(out, "{}", fn_get_name(sym.fn_ptr));
-            // right side
-            if (auto r = std::get_if<smrty::symbolic>(&(sym.right));
-                r && (*(*r)).fn_ptr != smrty::invalid_function &&
-                (*(*r)).prio() < sym.prio())
+            else if (n.fn_style == smrty::symbolic_op::postfix)
             {
-                out = std::format_to(out, "({})", *r);
+                operand(n.left);
+                name();
             }
-            else
+            else if (n.fn_style == smrty::symbolic_op::paren)
             {
-                out = std::format_to(out, "{}", sym.right);
+                name();
+                parts.emplace_back(std::string{"("});
+                operand(n.left);
+                if (!std::get_if<std::monostate>(&n.right))
+                {
+                    parts.emplace_back(std::string{", "});
+                    operand(n.right);
+                }
+                parts.emplace_back(std::string{")"});
             }
-        }
-        else if (sym.fn_style == smrty::symbolic_op::prefix)
-        {
-            out =
-                std::format_to(out, "{}{}", fn_get_name(sym.fn_ptr), sym.left);
-        }
-        else if (sym.fn_style == smrty::symbolic_op::postfix)
-        {
-            out =
-                std::format_to(out, "{}{}", sym.left, fn_get_name(sym.fn_ptr));
-        }
-        else if (sym.fn_style == smrty::symbolic_op::paren)
-        {
-            out =
-                std::format_to(out, "{}({}", fn_get_name(sym.fn_ptr), sym.left);
-            if (!std::get_if<std::monostate>(&sym.right))
+            else /* none */
             {
-                out = std::format_to(out, ", {}", sym.right);
+                parts.emplace_back(std::string{"("});
+                name();
+                parts.emplace_back(std::string{": "});
+                operand(n.left);
+                parts.emplace_back(std::string{", "});
+                operand(n.right);
+                parts.emplace_back(std::string{")"});
             }
-            *out++ = ')';
+            // the stack is last in, first out
+            work.insert(work.end(), std::make_move_iterator(parts.rbegin()),
+                        std::make_move_iterator(parts.rend()));
         }
-        else /* none */
-        {
-            out = std::format_to(out, "({}: {}, {})", fn_get_name(sym.fn_ptr),
-                                 sym.left, sym.right);
-        }
-        /*
-    none,
-    paren,
-    prefix,
-    infix,
-    postfix,
-    */
         return out;
     }
 };
@@ -305,19 +410,8 @@ struct std::formatter<smrty::symbolic>
     auto format(const smrty::symbolic& b, FormatContext& ctx) const
         -> decltype(ctx.out())
     {
-        // only quote the outer-most symbolic
-        static bool quotes = true;
-        auto out = ctx.out();
-        if (quotes)
-        {
-            quotes = false;
-            out = std::format_to(out, "'{}'", *b);
-            quotes = true;
-        }
-        else
-        {
-            out = std::format_to(out, "{}", *b);
-        }
-        return out;
+        // nested expressions are written by the symbolic_actual formatter
+        // without coming back here, so this is always the outer-most one
+        return std::format_to(ctx.out(), "'{}'", *b);
     }
 };
@@ -5,6 +5,7 @@ SPDX-License-Identifier: BSD-3-Clause
 */
 
 #include <calculator.hpp>
+#include <optimizer.hpp>
 #include <user_function.hpp>
 
 namespace smrty
@@ -13,6 +14,12 @@ namespace smrty
 UserFunction::UserFunction(const std::string& name, program&& prog) :
     _name(name), function(std::move(prog))
 {
+    optimizer_report report{};
+    compiled = optimize_program(function, report);
+    for (const auto& line : report)
+    {
+        lg::verbose("{}: {}\n", name, line);
+    }
     _help = std::format("\n"
                         "    User defined function: '{}'\n"
                         "\n"
@@ -29,7 +36,8 @@ const std::string& UserFunction::help() const
 }
 bool UserFunction::op(Calculator& calc) const
 {
-    program fn{function};
+    // folded constants assume unlimited integers
+    program fn{calc.config.fixed_bits ? function : compiled};
     return fn.execute(
         [&calc](const simple_instruction& itm, execution_flags& eflags) {
             bool retval = calc.run_one(itm);
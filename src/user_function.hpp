@@ -27,7 +27,10 @@ struct UserFunction : public CalcFunction
 
     std::string _help;
     std::string _name;
+    // function is what the user wrote and is used for display and saving;
+    // compiled is the optimized copy that normally gets run
     program function;
+    program compiled;
 };
 
 } // namespace smrty
@@ -0,0 +1,156 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <debug.hpp>
+#include <exception>
+#include <numeric.hpp>
+#include <worker_pool.hpp>
+
+namespace smrty
+{
+
+worker_pool& worker_pool::get()
+{
+    static worker_pool _this{};
+    return _this;
+}
+
+worker_pool::worker_pool()
+{
+    // the thread that hands out work always helps, so one less worker,
+    // but keep at least one so submitted background work always runs
+    unsigned int count = std::thread::hardware_concurrency();
+    count = count > 2 ? count - 1 : 1;
+    workers.reserve(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        workers.emplace_back(
+            [this](std::stop_token stop) { worker_loop(stop); });
+    }
+    lg::debug("worker_pool: started {} threads\n", count);
+}
+
+worker_pool::~worker_pool()
+{
+    for (auto& w : workers)
+    {
+        w.request_stop();
+    }
+    ready.notify_all();
+    workers.clear();
+}
+
+void worker_pool::enqueue(task&& t)
+{
+    // carry the caller's precision over to whichever thread runs this
+    int precision = default_precision;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.emplace_back([precision, t{std::move(t)}]() mutable {
+            set_thread_precision(precision);
+            t();
+        });
+    }
+    ready.notify_one();
+}
+
+void worker_pool::worker_loop(std::stop_token stop)
+{
+    while (!stop.stop_requested())
+    {
+        task next;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (!ready.wait(guard, stop, [this]() { return !tasks.empty(); }))
+            {
+                return;
+            }
+            next = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        next();
+    }
+}
+
+void worker_pool::parallel_for(size_t count,
+                               const std::function<void(size_t, size_t)>& fn,
+                               size_t min_chunk)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    min_chunk = std::max<size_t>(min_chunk, 1);
+    // a few chunks per thread evens out chunks that take longer than others
+    size_t chunks = std::min(count / min_chunk, concurrency() * 4);
+    if (chunks <= 1 || workers.empty())
+    {
+        fn(0, count);
+        return;
+    }
+    size_t chunk_size = (count + chunks - 1) / chunks;
+    chunks = (count + chunk_size - 1) / chunk_size;
+
+    struct shared_state
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::vector<std::exception_ptr> errors;
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+    // helpers may be scheduled after all the chunks are taken, so the
+    // state they touch must outlive this call; fn is only used while some
+    // chunk is still outstanding, which keeps this frame alive
+    auto state = std::make_shared<shared_state>();
+    state->errors.resize(chunks);
+    auto run_chunks = [state, &fn, chunks, chunk_size, count]() {
+        size_t ran = 0;
+        size_t c;
+        while ((c = state->next.fetch_add(1)) < chunks)
+        {
+            size_t begin = c * chunk_size;
+            size_t end = std::min(count, begin + chunk_size);
+            try
+            {
+                fn(begin, end);
+            }
+            catch (...)
+            {
+                state->errors[c] = std::current_exception();
+            }
+            ran++;
+        }
+        if (ran && (state->done.fetch_add(ran) + ran) == chunks)
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->finished.notify_all();
+        }
+    };
+
+    size_t helpers = std::min(workers.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; i++)
+    {
+        enqueue(run_chunks);
+    }
+    run_chunks();
+    {
+        std::unique_lock<std::mutex> guard(state->lock);
+        state->finished.wait(
+            guard, [&state, chunks]() { return state->done == chunks; });
+    }
+    for (auto& e : state->errors)
+    {
+        if (e)
+        {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+} // namespace smrty
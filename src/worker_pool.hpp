@@ -0,0 +1,78 @@
+/*
+Copyright © 2024 Vernon Mauery; All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace smrty
+{
+
+/*
+ * A lazily started pool of worker threads for functions that can split
+ * their work into independent pieces. Tasks run at the numeric precision
+ * of the thread that queued them. parallel_for has the calling thread take
+ * part in the work, so nested parallel calls cannot starve each other.
+ */
+class worker_pool
+{
+  public:
+    using task = std::move_only_function<void()>;
+
+    static worker_pool& get();
+
+    ~worker_pool();
+    worker_pool(const worker_pool&) = delete;
+    worker_pool(worker_pool&&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+    worker_pool& operator=(worker_pool&&) = delete;
+
+    // number of threads that can work at once, including the caller
+    size_t concurrency() const
+    {
+        return workers.size() + 1;
+    }
+
+    // run fn on a worker thread; the result (or exception) is delivered
+    // through the returned future
+    template <typename Fn>
+    auto submit(Fn&& fn) -> std::future<std::invoke_result_t<Fn>>
+    {
+        using R = std::invoke_result_t<Fn>;
+        std::packaged_task<R()> job(std::forward<Fn>(fn));
+        auto result = job.get_future();
+        enqueue([job{std::move(job)}]() mutable { job(); });
+        return result;
+    }
+
+    // call fn(begin, end) over [0, count) in chunks of at least min_chunk
+    // items, returning when all chunks are done. If any chunk throws, the
+    // exception from the lowest numbered chunk is rethrown.
+    void parallel_for(size_t count,
+                      const std::function<void(size_t, size_t)>& fn,
+                      size_t min_chunk = 1);
+
+  protected:
+    worker_pool();
+
+    void enqueue(task&& t);
+    void worker_loop(std::stop_token stop);
+
+    std::mutex lock;
+    std::condition_variable_any ready;
+    std::deque<task> tasks;
+    std::vector<std::jthread> workers;
+};
+
+} // namespace smrty